@@ -0,0 +1,599 @@
+/*
+    FaultInjector.c: inject faults in EFI_SMART_CARD_READER_PROTOCOL
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Usage from the UEFI Shell:
+ * FaultInjector.efi [-r reader] fault@first[/period][:us] ...
+ *
+ * The driver replaces every EFI_SMART_CARD_READER_PROTOCOL (or only the
+ * one of reader) by a wrapper. SCardTransmit() and SCardControl() calls
+ * are numbered from 1 for each reader and a fault is injected on call
+ * number first, then every period calls if period is given:
+ *  timeout   return EFI_TIMEOUT
+ *  error     return EFI_DEVICE_ERROR
+ *  truncate  return only half of the response
+ *  remove    the card is removed until the next SCardConnect()
+ *  latency   wait us microseconds before the call
+ * Example: FaultInjector.efi timeout@10 truncate@20/50 latency@1/1:2000
+ *
+ * For each fault the wrapper measures:
+ *  detected   time until the application calls the reader again
+ *  recovered  time and calls until the next successful exchange
+ * The report is printed by "unload", which also restores the original
+ * protocols. Unload FaultInjector before the reader driver.
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+#include <Protocol/SmartCardReader.h>
+#include <Protocol/LoadedImage.h>
+
+#include "../stopwatch.h"
+
+#define MAX_RULES 16
+#define MAX_RECORDS 64
+
+/* faults */
+#define FAULT_TIMEOUT 0
+#define FAULT_ERROR 1
+#define FAULT_TRUNCATE 2
+#define FAULT_REMOVE 3
+#define FAULT_LATENCY 4
+
+static CONST CHAR16 *fault_names[] = {
+	L"timeout", L"error", L"truncate", L"remove", L"latency" };
+
+/* fault@first[/period][:us] */
+typedef struct
+{
+	UINT32 fault;
+	UINT32 first;
+	UINT32 period;		/**< 0 for only once */
+	UINT32 latency_us;
+} RULE;
+
+/* one injected fault */
+typedef struct
+{
+	UINT32 fault;
+	UINT32 call;		/**< SCardTransmit/SCardControl call number */
+	UINT64 injected;	/**< StopwatchNow() */
+	UINT64 detected;	/**< 0 if the application did not call again */
+	UINT64 recovered;	/**< 0 if no successful exchange since */
+	UINT32 recovery_calls;
+} RECORD;
+
+#define WRAPPER_SIGNATURE SIGNATURE_32('f', 'i', 'n', 'j')
+
+typedef struct
+{
+	UINTN Signature;
+	EFI_SMART_CARD_READER_PROTOCOL SmartCardReader;	/**< the wrapper */
+	EFI_SMART_CARD_READER_PROTOCOL *Original;
+	EFI_HANDLE Handle;
+	UINTN index;
+	UINT32 calls;
+	BOOLEAN removed;
+	RECORD records[MAX_RECORDS];
+	UINTN nb_records;
+	RECORD *pending;	/**< last fault not recovered yet */
+} WRAPPER;
+
+#define WRAPPER_FROM_THIS(a) CR(a, WRAPPER, SmartCardReader, WRAPPER_SIGNATURE)
+
+static RULE rules[MAX_RULES];
+static UINTN nb_rules;
+static WRAPPER *wrappers;
+static UINTN nb_wrappers;
+
+/* StopwatchNow() ticks between begin and end, in ns */
+static UINT64 elapsed(UINT64 begin, UINT64 end)
+{
+	return StopwatchTicksToNs(StopwatchElapsed(begin, end));
+}
+
+/* the first call after a fault is the detection by the application */
+static void detect(WRAPPER *w)
+{
+	if (w->pending && (0 == w->pending->detected))
+		w->pending->detected = StopwatchNow();
+}
+
+/* a successful exchange ends the recovery */
+static void recover(WRAPPER *w)
+{
+	if (w->pending)
+	{
+		w->pending->recovered = StopwatchNow();
+		w->pending->recovery_calls = w->calls - w->pending->call;
+		w->pending = NULL;
+	}
+}
+
+/* return the fault to inject on this call or -1 */
+static int schedule(WRAPPER *w, UINT32 *latency_us)
+{
+	UINTN i;
+	int fault = -1;
+
+	*latency_us = 0;
+	for (i=0; i<nb_rules; i++)
+	{
+		RULE *r = &rules[i];
+
+		if ((w->calls < r->first)
+			|| ((0 == r->period) && (w->calls != r->first))
+			|| (r->period && ((w->calls - r->first) % r->period)))
+			continue;
+
+		/* latency is added to the other faults */
+		if (FAULT_LATENCY == r->fault)
+			*latency_us += r->latency_us;
+		else
+			fault = r->fault;
+	}
+
+	return fault;
+}
+
+static RECORD *record(WRAPPER *w, UINT32 fault)
+{
+	RECORD *r;
+
+	if (w->nb_records >= MAX_RECORDS)
+		return NULL;
+
+	r = &w->records[w->nb_records++];
+	ZeroMem(r, sizeof *r);
+	r->fault = fault;
+	r->call = w->calls;
+	r->injected = StopwatchNow();
+
+	return r;
+}
+
+/* common part of SCardTransmit() and SCardControl(); return TRUE if
+ * the call must not reach the reader */
+static BOOLEAN inject(WRAPPER *w, int *fault, EFI_STATUS *Status)
+{
+	UINT32 latency_us;
+	RECORD *r;
+
+	detect(w);
+	w->calls++;
+
+	*fault = schedule(w, &latency_us);
+	if (latency_us)
+	{
+		r = record(w, FAULT_LATENCY);
+		MicroSecondDelay(latency_us);
+		/* nothing to detect or recover */
+		if (r)
+			r->detected = r->recovered = StopwatchNow();
+	}
+
+	if (FAULT_REMOVE == *fault)
+		w->removed = TRUE;
+
+	if (*fault >= 0)
+	{
+		r = record(w, *fault);
+		if (r)
+			w->pending = r;
+	}
+
+	if (w->removed)
+	{
+		*Status = EFI_NO_MEDIA;
+		return TRUE;
+	}
+
+	switch (*fault)
+	{
+		case FAULT_TIMEOUT:
+			*Status = EFI_TIMEOUT;
+			return TRUE;
+
+		case FAULT_ERROR:
+			*Status = EFI_DEVICE_ERROR;
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static EFI_STATUS EFIAPI WrapperConnect(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 AccessMode,
+	IN UINT32 CardAction,
+	IN UINT32 PreferredProtocols,
+	OUT UINT32 *ActiveProtocol)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+
+	detect(w);
+
+	/* the card is inserted again */
+	w->removed = FALSE;
+
+	return w->Original->SCardConnect(w->Original, AccessMode, CardAction,
+		PreferredProtocols, ActiveProtocol);
+}
+
+static EFI_STATUS EFIAPI WrapperDisconnect(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 CardAction)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+
+	detect(w);
+
+	return w->Original->SCardDisconnect(w->Original, CardAction);
+}
+
+static EFI_STATUS EFIAPI WrapperStatus(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	OUT CHAR16 *ReaderName OPTIONAL,
+	IN OUT UINTN *ReaderNameLength OPTIONAL,
+	OUT UINT32 *State OPTIONAL,
+	OUT UINT32 *CardProtocol OPTIONAL,
+	OUT UINT8 *Atr OPTIONAL,
+	IN OUT UINTN *AtrLength OPTIONAL)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+	EFI_STATUS Status;
+
+	detect(w);
+
+	Status = w->Original->SCardStatus(w->Original, ReaderName,
+		ReaderNameLength, State, CardProtocol, Atr, AtrLength);
+
+	if (w->removed && State)
+		*State = SCARD_ABSENT;
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI WrapperTransmit(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT8 *CAPDU,
+	IN UINTN CAPDULength,
+	OUT UINT8 *RAPDU,
+	IN OUT UINTN *RAPDULength)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+	EFI_STATUS Status;
+	int fault;
+
+	if (inject(w, &fault, &Status))
+		return Status;
+
+	Status = w->Original->SCardTransmit(w->Original, CAPDU, CAPDULength,
+		RAPDU, RAPDULength);
+
+	if (!EFI_ERROR(Status) && (FAULT_TRUNCATE == fault))
+		*RAPDULength /= 2;
+	else
+		if (!EFI_ERROR(Status))
+			recover(w);
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI WrapperControl(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 ControlCode,
+	IN UINT8 *InBuffer OPTIONAL,
+	IN UINTN InBufferLength OPTIONAL,
+	OUT UINT8 *OutBuffer OPTIONAL,
+	IN OUT UINTN *OutBufferLength OPTIONAL)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+	EFI_STATUS Status;
+	int fault;
+
+	if (inject(w, &fault, &Status))
+		return Status;
+
+	Status = w->Original->SCardControl(w->Original, ControlCode,
+		InBuffer, InBufferLength, OutBuffer, OutBufferLength);
+
+	if (!EFI_ERROR(Status) && (FAULT_TRUNCATE == fault) && OutBufferLength)
+		*OutBufferLength /= 2;
+	else
+		if (!EFI_ERROR(Status))
+			recover(w);
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI WrapperGetAttrib(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 Attrib,
+	OUT UINT8 *OutBuffer,
+	IN OUT UINTN *OutBufferLength)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+
+	detect(w);
+
+	return w->Original->SCardGetAttrib(w->Original, Attrib, OutBuffer,
+		OutBufferLength);
+}
+
+static void Report(WRAPPER *w)
+{
+	UINTN i;
+
+	Print(L"reader %d: %d call(s), %d fault(s)\n", w->index, w->calls,
+		w->nb_records);
+
+	for (i=0; i<w->nb_records; i++)
+	{
+		RECORD *r = &w->records[i];
+
+		Print(L"  call %d %s: ", r->call, fault_names[r->fault]);
+
+		if (FAULT_LATENCY == r->fault)
+		{
+			Print(L"%ld us\n",
+				DivU64x32(elapsed(r->injected, r->recovered), 1000));
+			continue;
+		}
+
+		if (r->detected)
+			Print(L"detected after %ld us, ",
+				DivU64x32(elapsed(r->injected, r->detected), 1000));
+		else
+			Print(L"not detected, ");
+
+		if (r->recovered)
+			Print(L"recovered after %d call(s) %ld us\n", r->recovery_calls,
+				DivU64x32(elapsed(r->injected, r->recovered), 1000));
+		else
+			Print(L"not recovered\n");
+	}
+}
+
+/*
+ * Give the readers their original protocol back. A driver loaded over
+ * us still calls our wrappers: they are kept and EFI_ACCESS_DENIED is
+ * returned.
+ */
+static EFI_STATUS RemoveWrappers(void)
+{
+	EFI_SMART_CARD_READER_PROTOCOL *Current;
+	EFI_STATUS Status;
+	UINTN i;
+
+	for (i=0; i<nb_wrappers; i++)
+	{
+		WRAPPER *w = &wrappers[i];
+
+		if (w->Original
+			&& (EFI_ERROR(gBS->HandleProtocol(w->Handle,
+				&gEfiSmartCardReaderProtocolGuid, (VOID **)&Current))
+			|| (Current != &w->SmartCardReader)))
+		{
+			Print(L"ERROR: reader %d is wrapped by another driver\n",
+				w->index);
+			return EFI_ACCESS_DENIED;
+		}
+	}
+
+	for (i=0; i<nb_wrappers; i++)
+	{
+		WRAPPER *w = &wrappers[i];
+
+		if (!w->Original)
+			continue;
+
+		Status = gBS->ReinstallProtocolInterface(w->Handle,
+			&gEfiSmartCardReaderProtocolGuid, &w->SmartCardReader,
+			w->Original);
+		if (EFI_ERROR(Status))
+		{
+			Print(L"ERROR: reader %d: ReinstallProtocolInterface: %r\n",
+				w->index, Status);
+			/* the wrappers still forward to the original protocols */
+			return EFI_ACCESS_DENIED;
+		}
+	}
+
+	FreePool(wrappers);
+	wrappers = NULL;
+	nb_wrappers = 0;
+
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI FaultInjectorUnload(IN EFI_HANDLE ImageHandle)
+{
+	UINTN i;
+
+	for (i=0; i<nb_wrappers; i++)
+		if (wrappers[i].Original)
+			Report(&wrappers[i]);
+
+	return RemoveWrappers();
+}
+
+/* skip the current word and the spaces after it */
+static CHAR16 *next_word(CHAR16 *p)
+{
+	while (*p && (*p != L' '))
+		p++;
+	while (*p == L' ')
+		p++;
+
+	return p;
+}
+
+/* parse fault@first[/period][:us] */
+static int parse_rule(CHAR16 *p, RULE *r)
+{
+	UINTN i, length;
+
+	ZeroMem(r, sizeof *r);
+
+	for (i=0; i<ARRAY_SIZE(fault_names); i++)
+	{
+		length = StrLen(fault_names[i]);
+		if ((0 == StrnCmp(p, fault_names[i], length)) && (L'@' == p[length]))
+			break;
+	}
+	if (i >= ARRAY_SIZE(fault_names))
+		return -1;
+
+	r->fault = i;
+	p += length + 1;
+	r->first = StrDecimalToUintn(p);
+	if (0 == r->first)
+		return -1;
+
+	while ((*p >= L'0') && (*p <= L'9'))
+		p++;
+	if (L'/' == *p)
+	{
+		r->period = StrDecimalToUintn(++p);
+		while ((*p >= L'0') && (*p <= L'9'))
+			p++;
+	}
+	if (L':' == *p)
+		r->latency_us = StrDecimalToUintn(++p);
+
+	return 0;
+}
+
+/* return the reader to wrap or -1 for all */
+static int ParseLoadOptions(EFI_LOADED_IMAGE_PROTOCOL *LoadedImage)
+{
+	CHAR16 *p = LoadedImage->LoadOptions;
+	int reader = -1;
+
+	if ((NULL == p) || (0 == LoadedImage->LoadOptionsSize))
+		return reader;
+
+	/* skip the image name */
+	for (p = next_word(p); *p; p = next_word(p))
+	{
+		if ((L'-' == p[0]) && (L'r' == p[1]))
+		{
+			p = next_word(p);
+			reader = StrDecimalToUintn(p);
+			continue;
+		}
+
+		if (nb_rules >= MAX_RULES)
+			continue;
+
+		if (parse_rule(p, &rules[nb_rules]))
+			Print(L"ERROR: wrong fault: %s\n", p);
+		else
+			nb_rules++;
+	}
+
+	return reader;
+}
+
+EFI_STATUS EFIAPI FaultInjectorEntryPoint(
+	IN EFI_HANDLE ImageHandle,
+	IN EFI_SYSTEM_TABLE *SystemTable)
+{
+	EFI_STATUS Status;
+	EFI_LOADED_IMAGE_PROTOCOL *LoadedImage;
+	EFI_HANDLE *Handles = NULL;
+	UINTN HandleCount, i;
+	int reader;
+
+	Status = gBS->HandleProtocol(ImageHandle, &gEfiLoadedImageProtocolGuid,
+		(VOID **)&LoadedImage);
+	if (EFI_ERROR(Status))
+		return Status;
+
+	reader = ParseLoadOptions(LoadedImage);
+	if (0 == nb_rules)
+	{
+		Print(L"ERROR: no fault to inject\n");
+		return EFI_INVALID_PARAMETER;
+	}
+
+	StopwatchInit();
+
+	Status = gBS->LocateHandleBuffer(ByProtocol,
+		&gEfiSmartCardReaderProtocolGuid, NULL, &HandleCount, &Handles);
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: no EFI_SMART_CARD_READER_PROTOCOL\n");
+		return Status;
+	}
+
+	wrappers = AllocateZeroPool(HandleCount * sizeof *wrappers);
+	if (NULL == wrappers)
+	{
+		FreePool(Handles);
+		return EFI_OUT_OF_RESOURCES;
+	}
+	nb_wrappers = HandleCount;
+
+	for (i=0; i<HandleCount; i++)
+	{
+		WRAPPER *w = &wrappers[i];
+		EFI_SMART_CARD_READER_PROTOCOL *Original;
+
+		if ((reader >= 0) && (reader != i))
+			continue;
+
+		Status = gBS->HandleProtocol(Handles[i],
+			&gEfiSmartCardReaderProtocolGuid, (VOID **)&Original);
+		if (EFI_ERROR(Status))
+			continue;
+
+		w->Signature = WRAPPER_SIGNATURE;
+		w->SmartCardReader.SCardConnect = WrapperConnect;
+		w->SmartCardReader.SCardDisconnect = WrapperDisconnect;
+		w->SmartCardReader.SCardStatus = WrapperStatus;
+		w->SmartCardReader.SCardTransmit = WrapperTransmit;
+		w->SmartCardReader.SCardControl = WrapperControl;
+		w->SmartCardReader.SCardGetAttrib = WrapperGetAttrib;
+		w->Handle = Handles[i];
+		w->index = i;
+
+		Status = gBS->ReinstallProtocolInterface(Handles[i],
+			&gEfiSmartCardReaderProtocolGuid, Original, &w->SmartCardReader);
+		if (EFI_ERROR(Status))
+		{
+			Print(L"ERROR: reader %d: %r\n", i, Status);
+			continue;
+		}
+
+		w->Original = Original;
+		Print(L"reader %d: fault injection enabled\n", i);
+	}
+	FreePool(Handles);
+
+	LoadedImage->Unload = FaultInjectorUnload;
+
+	return EFI_SUCCESS;
+}
@@ -0,0 +1,66 @@
+/*
+
+Copyright (c) 2014, Gemalto. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+* Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in
+  the documentation and/or other materials provided with the
+  distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/SmartCardReader.h>
+
+#include "Common.h"
+
+void dump(CONST CHAR16 *text, UINT8 buffer[], UINTN length)
+{
+	UINTN i;
+
+	Print(L"%s: ", text);
+	for (i=0; i<length; i++)
+		Print(L"%02X ", buffer[i]);
+	Print(L"\n");
+}
+
+EFI_STATUS transmit(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	UINT8 CAPDU[], UINTN CAPDULength,
+	UINT8 RAPDU[], UINTN *RAPDULength)
+{
+	EFI_STATUS  Status;
+
+	dump(L"CAPDU", CAPDU, CAPDULength);
+	Status = SmartCardReader->SCardTransmit(SmartCardReader,
+		CAPDU, CAPDULength,
+		RAPDU, RAPDULength);
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: SCardTransmit: %d\n", Status);
+		return Status;
+	}
+	dump(L"RAPDU", RAPDU, *RAPDULength);
+
+	return Status;
+}
@@ -36,6 +36,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <Protocol/SmartCardReader.h>
 
+#include "Common.h"
+
 int HelloWorld(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 {
 	EFI_STATUS  Status;
@@ -65,45 +67,22 @@ int HelloWorld(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 	 */
 	CAPDULength = sizeof CAPDU_select;
 	RAPDULength = sizeof RAPDU;
-	Print(L"CAPDU: ");
-	for (i=0; i<CAPDULength; i++)
-		Print(L"%02X ", CAPDU_select[i]);
-	Print(L"\n");
-	Status = SmartCardReader->SCardTransmit(SmartCardReader,
+	Status = transmit(SmartCardReader,
 		CAPDU_select, CAPDULength,
 		RAPDU, &RAPDULength);
 	if (EFI_ERROR(Status))
-	{
-		Print(L"ERROR: SCardTransmit: %d\n", Status);
 		return 0;
 
-	}
-	Print(L"RAPDU: ");
-	for (i=0; i<RAPDULength; i++)
-		Print(L"%02X ", RAPDU[i]);
-	Print(L"\n");
-
 	/*
 	 * SCardTransmit Command
 	 */
 	CAPDULength = sizeof CAPDU_command;
 	RAPDULength = sizeof RAPDU;
-	Print(L"CAPDU: ");
-	for (i=0; i<CAPDULength; i++)
-		Print(L"%02X ", CAPDU_command[i]);
-	Print(L"\n");
-	Status = SmartCardReader->SCardTransmit(SmartCardReader,
+	Status = transmit(SmartCardReader,
 		CAPDU_command, CAPDULength,
 		RAPDU, &RAPDULength);
 	if (EFI_ERROR(Status))
-	{
-		Print(L"ERROR: SCardTransmit: %d\n", Status);
 		return 0;
-	}
-	Print(L"RAPDU: ");
-	for (i=0; i<RAPDULength; i++)
-		Print(L"%02X ", RAPDU[i]);
-	Print(L"\n");
 	for (i=0; i<RAPDULength; i++)
 		Print(L"%c", RAPDU[i]);
 	Print(L"\n");
@@ -0,0 +1,243 @@
+/*
+
+Copyright (c) 2026, Ludovic Rousseau. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+* Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in
+  the documentation and/or other materials provided with the
+  distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+/*
+ * Usage: apdu <reader> <APDU in hex> [-n <count>] [-d <delay in ms>] [-h]
+ *
+ * Send the APDU <count> times (1 by default) to the card in the reader
+ * number <reader> and wait <delay> ms between two commands.
+ * -h prints the histogram of the latencies.
+ * Example: apdu 0 00A4040006A0000000 18FF -n 100
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/ShellCEntryLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseMemoryLib.h>
+
+#include <Protocol/SmartCardReader.h>
+
+#include "Common.h"
+#include "../stopwatch.h"
+
+#define MAX_BUFFER_SIZE_EXTENDED    (4 + 3 + (1<<16) + 3 + 2)   /**< enhanced (64K + APDU + Lc + Le + SW) Tx/Rx Buffer */
+
+static UINT8 CAPDU[MAX_BUFFER_SIZE_EXTENDED];
+static UINT8 RAPDU[MAX_BUFFER_SIZE_EXTENDED];
+static UINT8 FirstRAPDU[MAX_BUFFER_SIZE_EXTENDED];
+
+static int hex_value(CHAR16 c)
+{
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+/* append the hex bytes of text to buffer */
+static int parse_hex(CONST CHAR16 *text, UINT8 buffer[], UINTN *length)
+{
+	while (*text)
+	{
+		int high, low;
+
+		if ((' ' == *text) || (':' == *text))
+		{
+			text++;
+			continue;
+		}
+
+		high = hex_value(text[0]);
+		low = hex_value(text[1]);
+		if ((high < 0) || (low < 0))
+			return 1;
+
+		if (*length >= sizeof CAPDU)
+			return 1;
+
+		buffer[(*length)++] = (high << 4) + low;
+		text += 2;
+	}
+
+	return 0;
+}
+
+INTN
+EFIAPI
+ShellAppMain (
+  IN UINTN Argc,
+  IN CHAR16 **Argv
+  )
+{
+	EFI_STATUS  Status;
+	UINTN       HandleCount;
+	EFI_HANDLE  *DevicePathHandleBuffer = NULL;
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader;
+	UINT32 ActiveProtocol;
+	UINTN CAPDULength = 0, RAPDULength, FirstRAPDULength = 0;
+	int reader = -1;
+	UINTN count = 1, delay = 0, done, different = 0;
+	BOOLEAN histogram = FALSE;
+	HISTOGRAM latency;
+	UINT64 t;
+	int i;
+
+	for (i=1; i<Argc; i++)
+	{
+		if (0 == StrCmp(Argv[i], L"-n") && (i+1 < Argc))
+			count = StrDecimalToUintn(Argv[++i]);
+		else if (0 == StrCmp(Argv[i], L"-d") && (i+1 < Argc))
+			delay = StrDecimalToUintn(Argv[++i]);
+		else if (0 == StrCmp(Argv[i], L"-h"))
+			histogram = TRUE;
+		else if (reader < 0)
+			reader = StrDecimalToUintn(Argv[i]);
+		else if (parse_hex(Argv[i], CAPDU, &CAPDULength))
+		{
+			Print(L"ERROR: invalid APDU: %s\n", Argv[i]);
+			return 1;
+		}
+	}
+
+	if ((reader < 0) || (0 == CAPDULength) || (0 == count))
+	{
+		Print(L"Usage: %s reader APDU [-n count] [-d delay_ms] [-h]\n", Argv[0]);
+		return 1;
+	}
+
+	/* EFI_SMART_CARD_READER_PROTOCOL */
+	Status = gBS->LocateHandleBuffer(
+			ByProtocol,
+			&gEfiSmartCardReaderProtocolGuid,
+			NULL,
+			&HandleCount,
+			&DevicePathHandleBuffer);
+
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: Get EFI_SMART_CARD_READER_PROTOCOL count fail.\n");
+		return 1;
+	}
+
+	if (reader >= HandleCount)
+	{
+		Print(L"ERROR: reader %d not found (%d reader(s))\n", reader,
+			HandleCount);
+		gBS->FreePool(DevicePathHandleBuffer);
+		return 1;
+	}
+
+	Status = gBS->HandleProtocol(
+			DevicePathHandleBuffer[reader],
+			&gEfiSmartCardReaderProtocolGuid,
+			(VOID**)&SmartCardReader);
+	gBS->FreePool(DevicePathHandleBuffer);
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: Open Protocol fail.\n");
+		return 1;
+	}
+
+	/*
+	 * SCardConnect
+	 */
+	Status = SmartCardReader->SCardConnect(SmartCardReader,
+		SCARD_AM_CARD,
+		SCARD_CA_COLDRESET,
+		SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
+		&ActiveProtocol);
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: SCardConnect: %d\n", Status);
+		return 1;
+	}
+
+	StopwatchInit();
+	HistogramReset(&latency);
+
+	dump(L"CAPDU", CAPDU, CAPDULength);
+	for (done = 0; done < count; done++)
+	{
+		STOPWATCH sw;
+
+		if (done && delay)
+			gBS->Stall(delay * 1000);
+
+		RAPDULength = sizeof RAPDU;
+		StopwatchStart(&sw);
+		Status = SmartCardReader->SCardTransmit(SmartCardReader,
+			CAPDU, CAPDULength,
+			RAPDU, &RAPDULength);
+		t = StopwatchStop(&sw);
+		if (EFI_ERROR(Status))
+		{
+			Print(L"ERROR: SCardTransmit #%d: %d\n", done + 1, Status);
+			break;
+		}
+		HistogramAdd(&latency, t);
+
+		if (0 == done)
+		{
+			CopyMem(FirstRAPDU, RAPDU, RAPDULength);
+			FirstRAPDULength = RAPDULength;
+			dump(L"RAPDU", RAPDU, RAPDULength);
+		}
+		else
+			if ((RAPDULength != FirstRAPDULength)
+				|| CompareMem(RAPDU, FirstRAPDU, RAPDULength))
+			{
+				different++;
+				dump(L"RAPDU", RAPDU, RAPDULength);
+			}
+	}
+
+	if (done)
+	{
+		Print(L"%d command(s): ", done);
+		HistogramPrint(&latency, 0, histogram);
+	}
+	if (different)
+		Print(L"%d response(s) different from the first one\n", different);
+
+	/*
+	 * SCardDisconnect
+	 */
+	Status = SmartCardReader->SCardDisconnect(SmartCardReader,
+		SCARD_CA_NORESET);
+	if (EFI_ERROR(Status))
+		Print(L"ERROR: SCardDisconnect: %d\n", Status);
+
+	return (done == count) ? 0 : 1;
+}
@@ -0,0 +1,433 @@
+/*
+    CompatLib.c: libc compatibility for the code ported on config.h
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * The short sleeps use gBS->Stall(). The longer ones wait for a timer
+ * event so the CPU is halted in the firmware idle loop instead of
+ * polling the reader. A timer event has the resolution of the system
+ * tick (often 10 ms) and cannot be waited for above TPL_APPLICATION;
+ * gBS->Stall() is used in that case.
+ *
+ * malloc() serves the short and extended APDU buffers from a pool of
+ * freed buffers. A buffer is in the class of the smallest size it fits
+ * in if it uses more than a quarter of it; the other sizes go directly
+ * to AllocatePool(). A header in front of each buffer gives its class
+ * to free(). In poison mode, the default of the DEBUG builds, the
+ * buffers are filled with 0xA5 when allocated and 0xDD when freed and a
+ * cached buffer is checked before its reuse.
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Protocol/Shell.h>
+
+#include "../../config.h"
+
+/* sleeps shorter than this use gBS->Stall(), in us */
+#define STALL_MAX_US 1000
+
+/* longest environment variable returned by getenv() */
+#define GETENV_MAX 256
+
+/* sizes of the pool classes, as MAX_BUFFER_SIZE and
+ * MAX_BUFFER_SIZE_EXTENDED of the applications */
+static CONST UINTN class_size[POOL_CLASSES] = {
+	4 + 3 + (1<<8) + 3 + 2,
+	4 + 3 + (1<<16) + 3 + 2
+};
+
+/* free buffers kept by class */
+#define POOL_CACHE_MAX 8
+
+#define POOL_SIGNATURE SIGNATURE_32('c', 'm', 'p', 'a')
+#define POOL_FREE_SIGNATURE SIGNATURE_32('c', 'm', 'p', 'f')
+
+/* no class */
+#define POOL_NONE POOL_CLASSES
+
+#define POISON_ALLOC 0xA5
+#define POISON_FREE 0xDD
+
+/* in front of each buffer, 8 bytes aligned */
+typedef struct POOL_BLOCK
+{
+	UINT32 Signature;
+	UINT32 Class;
+	UINT64 Size;
+	union
+	{
+		struct POOL_BLOCK *Next;	/**< next free buffer of the class */
+		UINT64 Pad;
+	} u;
+} POOL_BLOCK;
+
+int compat_errno;
+
+static POOL_BLOCK *free_list[POOL_CLASSES];
+static POOL_STATS stats;
+#ifdef MDEPKG_NDEBUG
+static BOOLEAN poison = FALSE;
+#else
+static BOOLEAN poison = TRUE;
+#endif
+
+static UINTN size_to_class(UINTN size)
+{
+	UINTN c;
+
+	for (c=0; c<POOL_CLASSES; c++)
+		if (size <= class_size[c])
+			return (size > class_size[c] / 4) ? c : POOL_NONE;
+
+	return POOL_NONE;
+}
+
+/* TRUE if the freed buffer still has its poison */
+static BOOLEAN poison_intact(CONST UINT8 *buffer, UINTN size)
+{
+	UINTN i;
+
+	for (i=0; i<size; i++)
+		if (POISON_FREE != buffer[i])
+			return FALSE;
+
+	return TRUE;
+}
+
+static void *pool_alloc(UINTN size)
+{
+	POOL_BLOCK *block = NULL;
+	POOL_CLASS_STATS *cs = NULL;
+	UINTN c;
+	EFI_TPL OldTpl;
+
+	c = size_to_class(size);
+
+	OldTpl = gBS->RaiseTPL(TPL_NOTIFY);
+	if (POOL_NONE == c)
+		stats.unpooled++;
+	else
+	{
+		cs = &stats.classes[c];
+		block = free_list[c];
+		if (block)
+		{
+			free_list[c] = block->u.Next;
+			cs->cached--;
+			cs->hits++;
+		}
+		else
+			cs->misses++;
+	}
+	gBS->RestoreTPL(OldTpl);
+
+	if (block)
+	{
+		if (poison && !poison_intact((UINT8 *)(block + 1), class_size[c]))
+			stats.errors++;
+	}
+	else
+	{
+		if (size > MAX_UINTN - sizeof *block)
+			return NULL;
+
+		block = AllocatePool(sizeof *block
+			+ ((POOL_NONE == c) ? size : class_size[c]));
+		if (NULL == block)
+			return NULL;
+	}
+
+	block->Signature = POOL_SIGNATURE;
+	block->Class = (UINT32)c;
+	block->Size = size;
+
+	if (cs)
+	{
+		OldTpl = gBS->RaiseTPL(TPL_NOTIFY);
+		cs->in_use++;
+		if (cs->in_use > cs->peak)
+			cs->peak = cs->in_use;
+		gBS->RestoreTPL(OldTpl);
+	}
+
+	if (poison)
+		SetMem(block + 1, size, POISON_ALLOC);
+
+	return block + 1;
+}
+
+void *compat_malloc(UINTN size)
+{
+	void *ptr;
+
+	/* unlike AllocateZeroPool(), do not clear the buffer */
+	ptr = pool_alloc(size);
+	if (NULL == ptr)
+		compat_errno = ENOMEM;
+
+	return ptr;
+}
+
+void *compat_calloc(UINTN nmemb, UINTN size)
+{
+	void *ptr;
+
+	if (size && (nmemb > MAX_UINTN / size))
+	{
+		compat_errno = ENOMEM;
+		return NULL;
+	}
+
+	ptr = pool_alloc(nmemb * size);
+	if (NULL == ptr)
+		compat_errno = ENOMEM;
+	else
+		ZeroMem(ptr, nmemb * size);
+
+	return ptr;
+}
+
+void compat_free(void *ptr)
+{
+	POOL_BLOCK *block;
+	UINTN c;
+	EFI_TPL OldTpl;
+
+	if (NULL == ptr)
+		return;
+
+	block = (POOL_BLOCK *)ptr - 1;
+	if (POOL_SIGNATURE != block->Signature)
+	{
+		/* double free or not from malloc(): leak it */
+		stats.errors++;
+		return;
+	}
+
+	c = block->Class;
+	if (POOL_NONE == c)
+	{
+		if (poison)
+			SetMem(ptr, (UINTN)block->Size, POISON_FREE);
+		block->Signature = POOL_FREE_SIGNATURE;
+		FreePool(block);
+		return;
+	}
+
+	if (poison)
+		SetMem(ptr, class_size[c], POISON_FREE);
+	block->Signature = POOL_FREE_SIGNATURE;
+
+	OldTpl = gBS->RaiseTPL(TPL_NOTIFY);
+	stats.classes[c].in_use--;
+	if (stats.classes[c].cached < POOL_CACHE_MAX)
+	{
+		block->u.Next = free_list[c];
+		free_list[c] = block;
+		stats.classes[c].cached++;
+		block = NULL;
+	}
+	gBS->RestoreTPL(OldTpl);
+
+	if (block)
+		FreePool(block);
+}
+
+void PoolPoison(BOOLEAN Enable)
+{
+	/* the cached buffers have no poison to check */
+	if (Enable && !poison)
+		PoolFlush();
+
+	poison = Enable;
+}
+
+void PoolGetStats(POOL_STATS *Stats)
+{
+	UINTN c;
+
+	*Stats = stats;
+	for (c=0; c<POOL_CLASSES; c++)
+		Stats->classes[c].size = class_size[c];
+}
+
+void PoolPrintStats(void)
+{
+	POOL_STATS s;
+	UINTN c;
+
+	PoolGetStats(&s);
+	Print(L"malloc pool%a\n", poison ? " (poison)" : "");
+	for (c=0; c<POOL_CLASSES; c++)
+	{
+		POOL_CLASS_STATS *cs = &s.classes[c];
+
+		Print(L" %6ld bytes: hits %ld, misses %ld, in use %ld (peak %ld), cached %ld\n",
+			(UINT64)cs->size, cs->hits, cs->misses, (UINT64)cs->in_use,
+			(UINT64)cs->peak, (UINT64)cs->cached);
+	}
+	Print(L" other sizes: %ld\n", s.unpooled);
+	if (s.errors)
+		Print(L" errors: %ld\n", s.errors);
+}
+
+void PoolFlush(void)
+{
+	POOL_BLOCK *block;
+	UINTN c;
+	EFI_TPL OldTpl;
+
+	for (c=0; c<POOL_CLASSES; c++)
+	{
+		OldTpl = gBS->RaiseTPL(TPL_NOTIFY);
+		block = free_list[c];
+		free_list[c] = NULL;
+		stats.classes[c].cached = 0;
+		gBS->RestoreTPL(OldTpl);
+
+		while (block)
+		{
+			POOL_BLOCK *next = block->u.Next;
+
+			FreePool(block);
+			block = next;
+		}
+	}
+}
+
+/* TRUE if WaitForEvent() is allowed */
+static BOOLEAN can_wait(void)
+{
+	EFI_TPL Tpl;
+
+	Tpl = gBS->RaiseTPL(TPL_HIGH_LEVEL);
+	gBS->RestoreTPL(Tpl);
+
+	return TPL_APPLICATION == Tpl;
+}
+
+int compat_usleep(UINTN usec)
+{
+	EFI_EVENT Timer;
+	EFI_STATUS Status;
+	UINTN Index;
+
+	if (usec < STALL_MAX_US || !can_wait())
+	{
+		gBS->Stall(usec);
+		return 0;
+	}
+
+	Status = gBS->CreateEvent(EVT_TIMER, TPL_CALLBACK, NULL, NULL, &Timer);
+	if (EFI_ERROR(Status))
+	{
+		gBS->Stall(usec);
+		return 0;
+	}
+
+	/* in units of 100 ns */
+	Status = gBS->SetTimer(Timer, TimerRelative, MultU64x32(usec, 10));
+	if (!EFI_ERROR(Status))
+		Status = gBS->WaitForEvent(1, &Timer, &Index);
+	gBS->CloseEvent(Timer);
+
+	if (EFI_ERROR(Status))
+		gBS->Stall(usec);
+
+	return 0;
+}
+
+unsigned int compat_sleep(unsigned int seconds)
+{
+	/* one second at a time so a UINTN of us does not overflow */
+	while (seconds--)
+		compat_usleep(1000000);
+
+	return 0;
+}
+
+int compat_strncmp(const char *s1, const char *s2, UINTN n)
+{
+	for (; n; n--, s1++, s2++)
+	{
+		if (*s1 != *s2)
+			return (unsigned char)*s1 - (unsigned char)*s2;
+		if ('\0' == *s1)
+			break;
+	}
+
+	return 0;
+}
+
+/* environment variable of the UEFI Shell, if any */
+char *compat_getenv(const char *name)
+{
+	static char value[GETENV_MAX];
+	EFI_SHELL_PROTOCOL *Shell;
+	CHAR16 Name[GETENV_MAX];
+	CONST CHAR16 *Value;
+	UINTN i;
+
+	if (EFI_ERROR(gBS->LocateProtocol(&gEfiShellProtocolGuid, NULL,
+		(VOID **)&Shell)))
+		return NULL;
+
+	for (i=0; name[i] && (i < GETENV_MAX - 1); i++)
+		Name[i] = name[i];
+	Name[i] = L'\0';
+
+	Value = Shell->GetEnv(Name);
+	if (NULL == Value)
+		return NULL;
+
+	for (i=0; Value[i] && (i < GETENV_MAX - 1); i++)
+		value[i] = (char)Value[i];
+	value[i] = '\0';
+
+	return value;
+}
+
+const char *compat_strerror(int errnum)
+{
+	switch (errnum)
+	{
+		case 0:
+			return "Success";
+		case EPERM:
+			return "Operation not permitted";
+		case EINTR:
+			return "Interrupted system call";
+		case EIO:
+			return "Input/output error";
+		case ENOMEM:
+			return "Cannot allocate memory";
+		case ENODEV:
+			return "No such device";
+		case EINVAL:
+			return "Invalid argument";
+		case ETIMEDOUT:
+			return "Connection timed out";
+	}
+
+	return "Unknown error";
+}
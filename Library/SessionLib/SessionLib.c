@@ -0,0 +1,232 @@
+/*
+    SessionLib.c: per card session parameters cached by ATR
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * A card seen before is connected with the protocol it used the last
+ * time instead of letting the reader choose between T=0 and T=1. The
+ * application can also reuse the AID and the APDU lengths found during
+ * the previous run. The entries are kept in the non volatile variable
+ * "SessionCache", the least recently used one is replaced first.
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Protocol/SmartCardReader.h>
+
+#define UEFI_DRIVER
+#include "../../reader.h"
+#include "../../session.h"
+#include "../../transmit.h"
+
+#define SESSION_VARIABLE L"SessionCache"
+#define SESSION_VERSION 2
+
+/* vendor GUID of the cache variable */
+static EFI_GUID SessionGuid =
+	{ 0x1abffdc9, 0xf092, 0x4aa9, { 0x8b, 0x7a, 0xf2, 0x02, 0x01, 0x4d, 0x67, 0xca } };
+
+EFI_STATUS SessionCacheLoad(SESSION_CACHE *Cache)
+{
+	UINTN Size = sizeof *Cache;
+	EFI_STATUS Status;
+
+	Status = gRT->GetVariable(SESSION_VARIABLE, &SessionGuid, NULL, &Size,
+		Cache);
+	if (!EFI_ERROR(Status) && ((Size != sizeof *Cache)
+		|| (Cache->version != SESSION_VERSION)
+		|| (Cache->count > SESSION_ENTRIES)))
+		Status = EFI_INCOMPATIBLE_VERSION;
+
+	if (EFI_ERROR(Status))
+	{
+		ZeroMem(Cache, sizeof *Cache);
+		Cache->version = SESSION_VERSION;
+	}
+
+	return Status;
+}
+
+EFI_STATUS SessionCacheSave(CONST SESSION_CACHE *Cache)
+{
+	return gRT->SetVariable(SESSION_VARIABLE, &SessionGuid,
+		EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+		sizeof *Cache, (VOID *)Cache);
+}
+
+static INTN find(CONST SESSION_CACHE *Cache, CONST UINT8 *Atr,
+	UINTN AtrLength)
+{
+	UINTN i;
+
+	for (i=0; i<Cache->count; i++)
+		if ((Cache->entries[i].AtrLength == AtrLength)
+			&& (0 == CompareMem(Cache->entries[i].Atr, Atr, AtrLength)))
+			return i;
+
+	return -1;
+}
+
+void SessionLookup(CONST SESSION_CACHE *Cache, CONST UINT8 *Atr,
+	UINTN AtrLength, SESSION *Session)
+{
+	INTN i = -1;
+	UINTN j;
+
+	ZeroMem(Session, sizeof *Session);
+
+	/* a too long ATR can not be cached */
+	if (AtrLength > SESSION_ATR_MAX)
+		AtrLength = 0;
+
+	if (Cache && AtrLength)
+		i = find(Cache, Atr, AtrLength);
+
+	if (i >= 0)
+	{
+		Session->entry = Cache->entries[i];
+		Session->cached = TRUE;
+	}
+	else
+	{
+		CopyMem(Session->entry.Atr, Atr, AtrLength);
+		Session->entry.AtrLength = (UINT8)AtrLength;
+		for (j=0; j<ARRAY_SIZE(Session->entry.max_length); j++)
+			Session->entry.max_length[j] = -1;
+	}
+}
+
+EFI_STATUS SessionConnect(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	UINT32 CardAction, SESSION *Session, UINT32 *ActiveProtocol)
+{
+	EFI_STATUS Status = EFI_NOT_FOUND;
+	UINT32 IFSC = 0;
+	UINTN Length = sizeof IFSC;
+
+	if (Session->cached && Session->entry.protocol && !Session->fallback)
+	{
+		Status = SmartCardReader->SCardConnect(SmartCardReader,
+			SCARD_AM_CARD, CardAction, Session->entry.protocol,
+			ActiveProtocol);
+		if (EFI_ERROR(Status))
+			/* another card with the same ATR, or a new reader */
+			Session->fallback = TRUE;
+	}
+
+	if (EFI_ERROR(Status))
+		Status = SmartCardReader->SCardConnect(SmartCardReader,
+			SCARD_AM_CARD, CardAction,
+			SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, ActiveProtocol);
+	if (EFI_ERROR(Status))
+		return Status;
+
+	if (*ActiveProtocol != Session->entry.protocol)
+	{
+		/* the other values may not be valid with this protocol */
+		Session->entry.protocol = *ActiveProtocol;
+		Session->entry.IFSC = 0;
+	}
+
+	/* optional attribute */
+	if ((SCARD_PROTOCOL_T1 == *ActiveProtocol)
+		&& !EFI_ERROR(SmartCardReader->SCardGetAttrib(SmartCardReader,
+			SCARD_ATTR_CURRENT_IFSC, (UINT8 *)&IFSC, &Length))
+		&& (Length <= sizeof IFSC))
+		Session->entry.IFSC = IFSC;
+
+	Session->entry.uses++;
+	Session->connected = TRUE;
+
+	return EFI_SUCCESS;
+}
+
+void SessionSetAid(SESSION *Session, CONST UINT8 *Aid, UINTN AidLength)
+{
+	if (AidLength > SESSION_AID_MAX)
+		AidLength = 0;
+
+	CopyMem(Session->entry.Aid, Aid, AidLength);
+	Session->entry.AidLength = (UINT8)AidLength;
+}
+
+/* same parameters, the use count apart */
+static BOOLEAN same_entry(CONST SESSION_ENTRY *a, CONST SESSION_ENTRY *b)
+{
+	return (a->AtrLength == b->AtrLength)
+		&& (0 == CompareMem(a->Atr, b->Atr, a->AtrLength))
+		&& (a->AidLength == b->AidLength)
+		&& (0 == CompareMem(a->Aid, b->Aid, a->AidLength))
+		&& (a->protocol == b->protocol)
+		&& (a->IFSC == b->IFSC)
+		&& (0 == CompareMem(a->max_length, b->max_length, sizeof a->max_length))
+		&& (a->transport == b->transport);
+}
+
+BOOLEAN SessionUpdate(SESSION_CACHE *Cache, CONST SESSION *Session)
+{
+	BOOLEAN changed = TRUE;
+	INTN i;
+
+	/* nothing to identify the card */
+	if (0 == Session->entry.AtrLength)
+		return FALSE;
+
+	i = find(Cache, Session->entry.Atr, Session->entry.AtrLength);
+	if (i >= 0)
+		changed = !same_entry(&Cache->entries[i], &Session->entry);
+	else
+	{
+		if (Cache->count < SESSION_ENTRIES)
+			Cache->count++;
+		else
+			/* forget the least recently used entry */
+			i = 0;
+	}
+
+	/* move the entry to the end of the list */
+	if (i >= 0)
+		CopyMem(&Cache->entries[i], &Cache->entries[i+1],
+			(Cache->count - i - 1) * sizeof Cache->entries[0]);
+	Cache->entries[Cache->count - 1] = Session->entry;
+
+	return changed;
+}
+
+void SessionPrint(CONST SESSION *Session)
+{
+	CONST SESSION_ENTRY *e = &Session->entry;
+	UINTN i;
+
+	Print(L"  session: %a, T=%d", Session->cached ?
+		(Session->fallback ? "cached, protocol refused" : "cached") : "new",
+		(SCARD_PROTOCOL_T1 == e->protocol) ? 1 : 0);
+	if (e->IFSC)
+		Print(L", IFSC %d", e->IFSC);
+	if (e->AidLength)
+	{
+		Print(L", AID ");
+		for (i=0; i<e->AidLength; i++)
+			Print(L"%02X", e->Aid[i]);
+	}
+	if (TRANSPORT_CHAINING == e->transport)
+		Print(L", command chaining");
+	Print(L", %d use(s)\n", e->uses);
+}
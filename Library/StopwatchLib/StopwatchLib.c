@@ -0,0 +1,265 @@
+/*
+    StopwatchLib.c: calibrated timestamps and latency histograms
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * On IA32 and X64 the time stamp counter is read with RDTSC, a few
+ * cycles, and its frequency is measured against gBS->Stall(). This
+ * needs an invariant TSC, present on all the recent CPUs. Elsewhere,
+ * or before StopwatchInit(), the TimerLib performance counter is used.
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/TimerLib.h>
+
+#include "../../stopwatch.h"
+
+/* duration of the calibration, in us */
+#define CALIBRATION_US 10000
+
+static BOOLEAN use_tsc;
+static UINT64 frequency;
+static UINT64 CounterStart, CounterEnd;
+
+/* frequency and direction of the TimerLib performance counter */
+static void properties(void)
+{
+	if (0 == frequency)
+		frequency = GetPerformanceCounterProperties(&CounterStart,
+			&CounterEnd);
+}
+
+EFI_STATUS StopwatchInit(void)
+{
+#if defined(MDE_CPU_IA32) || defined(MDE_CPU_X64)
+	UINT64 begin, end;
+	EFI_TPL OldTpl;
+
+	/* no event notification during the calibration */
+	OldTpl = gBS->RaiseTPL(TPL_NOTIFY);
+	begin = AsmReadTsc();
+	gBS->Stall(CALIBRATION_US);
+	end = AsmReadTsc();
+	gBS->RestoreTPL(OldTpl);
+
+	if (end > begin)
+	{
+		frequency = DivU64x32(MultU64x32(end - begin, 1000000),
+			CALIBRATION_US);
+		use_tsc = TRUE;
+		return EFI_SUCCESS;
+	}
+#endif
+
+	properties();
+
+	return EFI_SUCCESS;
+}
+
+UINT64 StopwatchFrequency(void)
+{
+	properties();
+
+	return frequency;
+}
+
+UINT64 StopwatchNow(void)
+{
+	UINT64 value;
+
+#if defined(MDE_CPU_IA32) || defined(MDE_CPU_X64)
+	if (use_tsc)
+		return AsmReadTsc();
+#endif
+
+	properties();
+	value = GetPerformanceCounter();
+	if (CounterEnd < CounterStart)
+		/* counting down */
+		return CounterStart - value;
+
+	return value - CounterStart;
+}
+
+UINT64 StopwatchElapsed(UINT64 begin, UINT64 end)
+{
+	if (end >= begin)
+		return end - begin;
+
+#if defined(MDE_CPU_IA32) || defined(MDE_CPU_X64)
+	/* a 64 bits TSC does not wrap */
+	if (use_tsc)
+		return 0;
+#endif
+
+	/* the performance counter wrapped around, StopwatchNow() went from
+	 * the end of its range back to 0 */
+	properties();
+	if (CounterEnd < CounterStart)
+		return (CounterStart - CounterEnd - begin) + end;
+
+	return (CounterEnd - CounterStart - begin) + end;
+}
+
+UINT64 StopwatchTicksToNs(UINT64 ticks)
+{
+	UINT64 seconds, remainder;
+
+	properties();
+
+	/* ticks x 10^9 would overflow after a few seconds */
+	seconds = DivU64x64Remainder(ticks, frequency, &remainder);
+
+	return MultU64x32(seconds, 1000000000)
+		+ DivU64x64Remainder(MultU64x32(remainder, 1000000000), frequency,
+			NULL);
+}
+
+void StopwatchStart(STOPWATCH *sw)
+{
+	sw->start = StopwatchNow();
+}
+
+UINT64 StopwatchStop(STOPWATCH *sw)
+{
+	return StopwatchTicksToNs(StopwatchElapsed(sw->start, StopwatchNow()));
+}
+
+void HistogramReset(HISTOGRAM *h)
+{
+	ZeroMem(h, sizeof *h);
+}
+
+void HistogramAdd(HISTOGRAM *h, UINT64 ns)
+{
+	UINT64 us = DivU64x32(ns, 1000);
+	UINTN bucket = (us < 2) ? 0 : (UINTN)HighBitSet64(us);
+
+	if (bucket >= HISTOGRAM_BUCKETS)
+		bucket = HISTOGRAM_BUCKETS - 1;
+
+	if ((0 == h->count) || (ns < h->min_ns))
+		h->min_ns = ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+	h->count++;
+	h->total_ns += ns;
+	h->buckets[bucket]++;
+}
+
+void HistogramMerge(HISTOGRAM *to, CONST HISTOGRAM *from)
+{
+	UINTN i;
+
+	if (0 == from->count)
+		return;
+
+	if ((0 == to->count) || (from->min_ns < to->min_ns))
+		to->min_ns = from->min_ns;
+	if (from->max_ns > to->max_ns)
+		to->max_ns = from->max_ns;
+	to->count += from->count;
+	to->total_ns += from->total_ns;
+	for (i=0; i<HISTOGRAM_BUCKETS; i++)
+		to->buckets[i] += from->buckets[i];
+}
+
+/*
+ * The values are assumed evenly spread in their bucket: the result is
+ * interpolated between the bounds of the bucket of the percent-th value
+ * and kept within [min, max].
+ */
+UINT64 HistogramPercentile(CONST HISTOGRAM *h, UINTN percent)
+{
+	UINT64 target, seen = 0, low, high, value;
+	UINT64 min_us = DivU64x32(h->min_ns, 1000);
+	UINT64 max_us = DivU64x32(h->max_ns, 1000);
+	UINTN i;
+
+	if (0 == h->count)
+		return 0;
+
+	target = DivU64x32(MultU64x32(h->count, (UINT32)percent) + 99, 100);
+	if (0 == target)
+		target = 1;
+
+	for (i=0; i<HISTOGRAM_BUCKETS - 1; i++)
+	{
+		if (seen + h->buckets[i] >= target)
+			break;
+		seen += h->buckets[i];
+	}
+
+	low = (0 == i) ? 0 : LShiftU64(1, i);
+	high = (HISTOGRAM_BUCKETS - 1 == i) ? max_us : LShiftU64(1, i+1);
+	if (high > max_us)
+		high = max_us;
+	if (low < min_us)
+		low = min_us;
+	if (high <= low)
+		return low;
+
+	/* target - seen is in [1, buckets[i]] */
+	value = low + DivU64x64Remainder(MultU64x64(high - low, target - seen),
+		h->buckets[i], NULL);
+
+	return value;
+}
+
+static void indent_by(UINTN indent)
+{
+	while (indent--)
+		Print(L" ");
+}
+
+void HistogramPrint(CONST HISTOGRAM *h, UINTN indent, BOOLEAN buckets)
+{
+	UINTN i;
+
+	if (0 == h->count)
+		return;
+
+	indent_by(indent);
+	Print(L"min %ld us, avg %ld us, max %ld us\n",
+		DivU64x32(h->min_ns, 1000),
+		DivU64x64Remainder(h->total_ns, MultU64x32(h->count, 1000), NULL),
+		DivU64x32(h->max_ns, 1000));
+
+	if (!buckets)
+		return;
+
+	for (i=0; i<HISTOGRAM_BUCKETS; i++)
+	{
+		if (0 == h->buckets[i])
+			continue;
+
+		indent_by(indent + 2);
+		if (0 == i)
+			Print(L"< 2 us: %ld\n", h->buckets[i]);
+		else
+			if (HISTOGRAM_BUCKETS - 1 == i)
+				Print(L">= %ld us: %ld\n", LShiftU64(1, i), h->buckets[i]);
+			else
+				Print(L"%ld-%ld us: %ld\n", LShiftU64(1, i),
+					LShiftU64(1, i+1) - 1, h->buckets[i]);
+	}
+}
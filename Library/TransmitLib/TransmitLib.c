@@ -0,0 +1,332 @@
+/*
+    TransmitLib.c: SCardTransmit/SCardControl with a retry policy
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * A failed exchange is sent again after a delay doubling at each
+ * attempt. Before the last attempt the card is reconnected with a warm
+ * reset, and the application selects its applet again from the
+ * Reconnected callback. The time spent recovering is charged to a
+ * budget so a dead reader does not slow down a long run forever.
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/TimerLib.h>
+#include <Protocol/SmartCardReader.h>
+
+#include "../../transmit.h"
+#include "../../stopwatch.h"
+
+/* one SCardTransmit or SCardControl call */
+typedef struct
+{
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader;
+	BOOLEAN control;
+	UINT32 ControlCode;
+	UINT8 *In;
+	UINTN InLength;
+	UINT8 *Out;
+	UINTN *OutLength;
+	UINTN OutSize;		/**< *OutLength before the first attempt */
+} REQUEST;
+
+void RetryInit(RETRY *Retry)
+{
+	Retry->policy.max_attempts = 3;
+	Retry->policy.backoff_us = 1000;
+	Retry->policy.max_backoff_us = 100000;
+	Retry->policy.warm_reset = TRUE;
+	Retry->policy.budget_us = 10000000;
+	ZeroMem(&Retry->stats, sizeof Retry->stats);
+	Retry->Reconnected = NULL;
+	Retry->Context = NULL;
+}
+
+void RetryDisable(RETRY *Retry)
+{
+	RetryInit(Retry);
+	Retry->policy.max_attempts = 1;
+	Retry->policy.warm_reset = FALSE;
+}
+
+/* errors that may disappear if the exchange is sent again */
+static BOOLEAN transient(EFI_STATUS Status)
+{
+	return (EFI_TIMEOUT == Status) || (EFI_DEVICE_ERROR == Status)
+		|| (EFI_NO_MEDIA == Status) || (EFI_NOT_READY == Status);
+}
+
+static EFI_STATUS attempt(REQUEST *req)
+{
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader = req->SmartCardReader;
+
+	/* the previous attempt may have changed the length */
+	if (req->OutLength)
+		*req->OutLength = req->OutSize;
+
+	if (req->control)
+		return SmartCardReader->SCardControl(SmartCardReader,
+			req->ControlCode, req->In, req->InLength,
+			req->Out, req->OutLength);
+
+	return SmartCardReader->SCardTransmit(SmartCardReader,
+		req->In, req->InLength, req->Out, req->OutLength);
+}
+
+static void reconnect(RETRY *Retry, EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
+{
+	EFI_STATUS Status;
+	UINT32 ActiveProtocol;
+
+	Retry->stats.reconnects++;
+
+	SmartCardReader->SCardDisconnect(SmartCardReader, SCARD_CA_NORESET);
+	Status = SmartCardReader->SCardConnect(SmartCardReader,
+		SCARD_AM_CARD,
+		SCARD_CA_WARMRESET,
+		SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
+		&ActiveProtocol);
+
+	if (!EFI_ERROR(Status) && Retry->Reconnected)
+		Retry->Reconnected(Retry->Context);
+}
+
+static EFI_STATUS run(RETRY *Retry, REQUEST *req)
+{
+	RETRY_POLICY *policy = &Retry->policy;
+	EFI_STATUS Status;
+	STOPWATCH sw;
+	UINT64 spent;
+	UINTN n, delay;
+
+	Retry->stats.exchanges++;
+	req->OutSize = req->OutLength ? *req->OutLength : 0;
+
+	Status = attempt(req);
+	if (!transient(Status) || (policy->max_attempts <= 1))
+		return Status;
+
+	StopwatchStart(&sw);
+	delay = policy->backoff_us;
+	for (n = 1; n < policy->max_attempts; n++)
+	{
+		spent = StopwatchStop(&sw);
+		if (policy->budget_us
+			&& (Retry->stats.recovery_ns + spent >= policy->budget_us * 1000))
+		{
+			Retry->stats.over_budget++;
+			break;
+		}
+
+		MicroSecondDelay(delay);
+		delay *= 2;
+		if (delay > policy->max_backoff_us)
+			delay = policy->max_backoff_us;
+
+		/* warm reset before the last attempt */
+		if (policy->warm_reset && (n == policy->max_attempts - 1))
+			reconnect(Retry, req->SmartCardReader);
+
+		Retry->stats.retries++;
+		Status = attempt(req);
+		if (!transient(Status))
+			break;
+	}
+
+	Retry->stats.recovery_ns += StopwatchStop(&sw);
+
+	if (EFI_ERROR(Status))
+		Retry->stats.failed++;
+	else
+		Retry->stats.recovered++;
+
+	return Status;
+}
+
+EFI_STATUS TransmitWithRetry(RETRY *Retry,
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	UINT8 *CAPDU, UINTN CAPDULength,
+	UINT8 *RAPDU, UINTN *RAPDULength)
+{
+	REQUEST req;
+
+	ZeroMem(&req, sizeof req);
+	req.SmartCardReader = SmartCardReader;
+	req.In = CAPDU;
+	req.InLength = CAPDULength;
+	req.Out = RAPDU;
+	req.OutLength = RAPDULength;
+
+	return run(Retry, &req);
+}
+
+/*
+ * Send the extended APDU as chained short commands, then collect the
+ * response with GET RESPONSE while the card answers 61xx.
+ */
+static EFI_STATUS transmit_chained(RETRY *Retry,
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	UINT8 *CAPDU, UINTN CAPDULength,
+	UINT8 *RAPDU, UINTN *RAPDULength)
+{
+	UINT8 c[5 + 255 + 1];
+	UINT8 r[256 + 2];
+	UINTN lc, le = 0, offset = 0, n, length, r_length, data;
+	UINTN size = *RAPDULength, received = 0;
+	BOOLEAN has_le, last;
+	EFI_STATUS Status;
+
+	/* CLA INS P1 P2 00 [Lc1 Lc2 Data] [Le1 Le2] */
+	if (7 == CAPDULength)
+	{
+		lc = 0;
+		has_le = TRUE;
+		le = (CAPDU[5] << 8) | CAPDU[6];
+	}
+	else
+	{
+		lc = (CAPDU[5] << 8) | CAPDU[6];
+		has_le = (CAPDULength == 9 + lc);
+		if (has_le)
+			le = (CAPDU[7 + lc] << 8) | CAPDU[8 + lc];
+		else
+			if (CAPDULength != 7 + lc)
+				return EFI_INVALID_PARAMETER;
+	}
+
+	do
+	{
+		n = (lc - offset > 255) ? 255 : lc - offset;
+		last = (offset + n == lc);
+
+		/* CLA b5: more commands follow */
+		c[0] = last ? CAPDU[0] : CAPDU[0] | 0x10;
+		CopyMem(c + 1, CAPDU + 1, 3);
+		length = 4;
+		if (n)
+		{
+			c[length++] = (UINT8)n;
+			CopyMem(c + length, CAPDU + 7 + offset, n);
+			length += n;
+		}
+		/* 256 or more, or 65536 coded 00 00, is a short Le of 00 */
+		if (last && has_le)
+			c[length++] = ((0 == le) || (le > 255)) ? 0 : (UINT8)le;
+
+		r_length = sizeof r;
+		Status = TransmitWithRetry(Retry, SmartCardReader, c, length,
+			r, &r_length);
+		if (EFI_ERROR(Status))
+			return Status;
+		if (r_length < 2)
+			return EFI_DEVICE_ERROR;
+
+		/* chaining refused: the status word is the answer */
+		if (!last && ((r_length != 2) || (0x90 != r[0]) || (0x00 != r[1])))
+			break;
+
+		offset += n;
+	} while (!last);
+
+	for (;;)
+	{
+		data = r_length - 2;
+		if (received + data + 2 > size)
+		{
+			*RAPDULength = received + data + 2;
+			return EFI_BUFFER_TOO_SMALL;
+		}
+		CopyMem(RAPDU + received, r, data);
+		received += data;
+
+		if (0x61 != r[data])
+			break;
+
+		/* GET RESPONSE of SW2 bytes, 00 for 256 */
+		c[0] = CAPDU[0];
+		c[1] = 0xC0;
+		c[2] = 0x00;
+		c[3] = 0x00;
+		c[4] = r[data + 1];
+
+		r_length = sizeof r;
+		Status = TransmitWithRetry(Retry, SmartCardReader, c, 5,
+			r, &r_length);
+		if (EFI_ERROR(Status))
+			return Status;
+		if (r_length < 2)
+			return EFI_DEVICE_ERROR;
+	}
+
+	RAPDU[received] = r[data];
+	RAPDU[received + 1] = r[data + 1];
+	*RAPDULength = received + 2;
+
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS TransmitLarge(RETRY *Retry,
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader, UINTN Transport,
+	UINT8 *CAPDU, UINTN CAPDULength,
+	UINT8 *RAPDU, UINTN *RAPDULength)
+{
+	/* short APDU: nothing to split */
+	if ((TRANSPORT_CHAINING == Transport) && (CAPDULength >= 7)
+		&& (0 == CAPDU[4]))
+		return transmit_chained(Retry, SmartCardReader, CAPDU, CAPDULength,
+			RAPDU, RAPDULength);
+
+	return TransmitWithRetry(Retry, SmartCardReader, CAPDU, CAPDULength,
+		RAPDU, RAPDULength);
+}
+
+EFI_STATUS ControlWithRetry(RETRY *Retry,
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	UINT32 ControlCode,
+	UINT8 *InBuffer, UINTN InBufferLength,
+	UINT8 *OutBuffer, UINTN *OutBufferLength)
+{
+	REQUEST req;
+
+	ZeroMem(&req, sizeof req);
+	req.SmartCardReader = SmartCardReader;
+	req.control = TRUE;
+	req.ControlCode = ControlCode;
+	req.In = InBuffer;
+	req.InLength = InBufferLength;
+	req.Out = OutBuffer;
+	req.OutLength = OutBufferLength;
+
+	return run(Retry, &req);
+}
+
+void RetryPrintStats(CONST RETRY *Retry)
+{
+	CONST RETRY_STATS *stats = &Retry->stats;
+
+	if (0 == stats->retries + stats->over_budget)
+		return;
+
+	Print(L"  retries: %d, reconnects: %d, recovered: %d, failed: %d, "
+		L"over budget: %d, recovery time: %ld us\n",
+		stats->retries, stats->reconnects, stats->recovered, stats->failed,
+		stats->over_budget, DivU64x32(stats->recovery_ns, 1000));
+}
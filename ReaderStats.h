@@ -0,0 +1,76 @@
+/*
+    ReaderStats.h: statistics of the EFI_SMART_CARD_READER_PROTOCOL calls
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __READERSTATS_H__
+#define __READERSTATS_H__
+
+#include "stopwatch.h"
+
+/* protocol installed by the ReaderStats driver */
+#define READER_STATS_PROTOCOL_GUID \
+	{ 0xf3daf3dd, 0xeaf0, 0x4b95, { 0xb8, 0xdb, 0x96, 0x8a, 0x89, 0x79, 0x0e, 0x19 } }
+
+#define READER_STATS_REVISION 1
+
+/* functions of EFI_SMART_CARD_READER_PROTOCOL */
+#define STATS_CONNECT 0
+#define STATS_DISCONNECT 1
+#define STATS_STATUS 2
+#define STATS_TRANSMIT 3
+#define STATS_CONTROL 4
+#define STATS_GETATTRIB 5
+#define STATS_FUNCTIONS 6
+
+typedef struct
+{
+	UINT64 calls;
+	UINT64 errors;		/**< calls returning an EFI error */
+	UINT64 bytes_sent;	/**< CAPDU or InBuffer */
+	UINT64 bytes_received;	/**< RAPDU, OutBuffer, ATR or attribute */
+	HISTOGRAM latency;
+} FUNCTION_STATS;
+
+typedef struct
+{
+	UINTN index;		/**< in the order the readers were wrapped */
+	EFI_HANDLE Handle;
+	CHAR16 ReaderName[100];
+	FUNCTION_STATS functions[STATS_FUNCTIONS];
+} READER_STATS;
+
+typedef struct _READER_STATS_PROTOCOL READER_STATS_PROTOCOL;
+
+/* copy the counters of reader Index, EFI_NOT_FOUND after the last one */
+typedef EFI_STATUS (EFIAPI *READER_STATS_GET)(
+	IN READER_STATS_PROTOCOL *This,
+	IN UINTN Index,
+	OUT READER_STATS *Stats);
+
+/* set the counters of all the readers to 0 */
+typedef EFI_STATUS (EFIAPI *READER_STATS_RESET)(
+	IN READER_STATS_PROTOCOL *This);
+
+struct _READER_STATS_PROTOCOL
+{
+	UINT32 Revision;
+	READER_STATS_GET GetStats;
+	READER_STATS_RESET Reset;
+};
+
+#endif
@@ -0,0 +1,430 @@
+/*
+    ReaderStats.c: statistics of the EFI_SMART_CARD_READER_PROTOCOL calls
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Usage from the UEFI Shell:
+ * ReaderStats.efi
+ *
+ * The driver replaces every EFI_SMART_CARD_READER_PROTOCOL by a wrapper
+ * that calls the original protocol and counts, for each function, the
+ * calls, the errors, the bytes sent and received and the latency. The
+ * readers installed after the driver are wrapped too.
+ *
+ * The counters are read and reset with the READER_STATS_PROTOCOL, see
+ * the scstat application. "unload" restores the original protocols; it
+ * fails if another driver (like FaultInjector) was loaded over this one
+ * and is still loaded. Unload ReaderStats before the reader driver.
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/SynchronizationLib.h>
+#include <Protocol/SmartCardReader.h>
+#include <Protocol/LoadedImage.h>
+
+#include "../ReaderStats.h"
+
+#define WRAPPER_SIGNATURE SIGNATURE_32('s', 't', 'a', 't')
+
+typedef struct
+{
+	UINTN Signature;
+	EFI_SMART_CARD_READER_PROTOCOL SmartCardReader;	/**< the wrapper */
+	EFI_SMART_CARD_READER_PROTOCOL *Original;
+	LIST_ENTRY Link;
+	SPIN_LOCK lock;		/**< the wrapper may be called from an AP */
+	READER_STATS stats;
+} WRAPPER;
+
+#define WRAPPER_FROM_THIS(a) CR(a, WRAPPER, SmartCardReader, WRAPPER_SIGNATURE)
+#define WRAPPER_FROM_LINK(a) CR(a, WRAPPER, Link, WRAPPER_SIGNATURE)
+
+static EFI_GUID gReaderStatsProtocolGuid = READER_STATS_PROTOCOL_GUID;
+
+static LIST_ENTRY wrappers = INITIALIZE_LIST_HEAD_VARIABLE(wrappers);
+static UINTN nb_wrappers;
+static EFI_EVENT NotifyEvent;
+static VOID *Registration;
+static EFI_HANDLE StatsHandle;
+static READER_STATS_PROTOCOL ReaderStats;
+
+/* add a call started with sw to the counters of function */
+static void account(WRAPPER *w, UINTN function, STOPWATCH *sw,
+	EFI_STATUS Status, UINTN sent, UINTN received)
+{
+	FUNCTION_STATS *f = &w->stats.functions[function];
+	UINT64 ns = StopwatchStop(sw);
+
+	AcquireSpinLock(&w->lock);
+	f->calls++;
+	if (EFI_ERROR(Status))
+		f->errors++;
+	else
+		f->bytes_received += received;
+	f->bytes_sent += sent;
+	HistogramAdd(&f->latency, ns);
+	ReleaseSpinLock(&w->lock);
+}
+
+static EFI_STATUS EFIAPI WrapperConnect(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 AccessMode,
+	IN UINT32 CardAction,
+	IN UINT32 PreferredProtocols,
+	OUT UINT32 *ActiveProtocol)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+	EFI_STATUS Status;
+	STOPWATCH sw;
+
+	StopwatchStart(&sw);
+	Status = w->Original->SCardConnect(w->Original, AccessMode, CardAction,
+		PreferredProtocols, ActiveProtocol);
+	account(w, STATS_CONNECT, &sw, Status, 0, 0);
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI WrapperDisconnect(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 CardAction)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+	EFI_STATUS Status;
+	STOPWATCH sw;
+
+	StopwatchStart(&sw);
+	Status = w->Original->SCardDisconnect(w->Original, CardAction);
+	account(w, STATS_DISCONNECT, &sw, Status, 0, 0);
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI WrapperStatus(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	OUT CHAR16 *ReaderName OPTIONAL,
+	IN OUT UINTN *ReaderNameLength OPTIONAL,
+	OUT UINT32 *State OPTIONAL,
+	OUT UINT32 *CardProtocol OPTIONAL,
+	OUT UINT8 *Atr OPTIONAL,
+	IN OUT UINTN *AtrLength OPTIONAL)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+	EFI_STATUS Status;
+	STOPWATCH sw;
+
+	StopwatchStart(&sw);
+	Status = w->Original->SCardStatus(w->Original, ReaderName,
+		ReaderNameLength, State, CardProtocol, Atr, AtrLength);
+	account(w, STATS_STATUS, &sw, Status, 0,
+		(Atr && AtrLength) ? *AtrLength : 0);
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI WrapperTransmit(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT8 *CAPDU,
+	IN UINTN CAPDULength,
+	OUT UINT8 *RAPDU,
+	IN OUT UINTN *RAPDULength)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+	EFI_STATUS Status;
+	STOPWATCH sw;
+
+	StopwatchStart(&sw);
+	Status = w->Original->SCardTransmit(w->Original, CAPDU, CAPDULength,
+		RAPDU, RAPDULength);
+	account(w, STATS_TRANSMIT, &sw, Status, CAPDULength,
+		RAPDULength ? *RAPDULength : 0);
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI WrapperControl(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 ControlCode,
+	IN UINT8 *InBuffer OPTIONAL,
+	IN UINTN InBufferLength OPTIONAL,
+	OUT UINT8 *OutBuffer OPTIONAL,
+	IN OUT UINTN *OutBufferLength OPTIONAL)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+	EFI_STATUS Status;
+	STOPWATCH sw;
+
+	StopwatchStart(&sw);
+	Status = w->Original->SCardControl(w->Original, ControlCode,
+		InBuffer, InBufferLength, OutBuffer, OutBufferLength);
+	account(w, STATS_CONTROL, &sw, Status, InBufferLength,
+		OutBufferLength ? *OutBufferLength : 0);
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI WrapperGetAttrib(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 Attrib,
+	OUT UINT8 *OutBuffer,
+	IN OUT UINTN *OutBufferLength)
+{
+	WRAPPER *w = WRAPPER_FROM_THIS(This);
+	EFI_STATUS Status;
+	STOPWATCH sw;
+
+	StopwatchStart(&sw);
+	Status = w->Original->SCardGetAttrib(w->Original, Attrib, OutBuffer,
+		OutBufferLength);
+	account(w, STATS_GETATTRIB, &sw, Status, 0,
+		OutBufferLength ? *OutBufferLength : 0);
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI GetStats(
+	IN READER_STATS_PROTOCOL *This,
+	IN UINTN Index,
+	OUT READER_STATS *Stats)
+{
+	LIST_ENTRY *Link;
+	EFI_TPL OldTpl;
+	EFI_STATUS Status = EFI_NOT_FOUND;
+
+	if (NULL == Stats)
+		return EFI_INVALID_PARAMETER;
+
+	/* no reader added while walking the list */
+	OldTpl = gBS->RaiseTPL(TPL_CALLBACK);
+	for (Link = GetFirstNode(&wrappers); !IsNull(&wrappers, Link);
+		Link = GetNextNode(&wrappers, Link))
+	{
+		WRAPPER *w = WRAPPER_FROM_LINK(Link);
+
+		if (w->stats.index != Index)
+			continue;
+
+		AcquireSpinLock(&w->lock);
+		CopyMem(Stats, &w->stats, sizeof *Stats);
+		ReleaseSpinLock(&w->lock);
+		Status = EFI_SUCCESS;
+		break;
+	}
+	gBS->RestoreTPL(OldTpl);
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI ResetStats(IN READER_STATS_PROTOCOL *This)
+{
+	LIST_ENTRY *Link;
+	EFI_TPL OldTpl;
+
+	OldTpl = gBS->RaiseTPL(TPL_CALLBACK);
+	for (Link = GetFirstNode(&wrappers); !IsNull(&wrappers, Link);
+		Link = GetNextNode(&wrappers, Link))
+	{
+		WRAPPER *w = WRAPPER_FROM_LINK(Link);
+
+		AcquireSpinLock(&w->lock);
+		ZeroMem(w->stats.functions, sizeof w->stats.functions);
+		ReleaseSpinLock(&w->lock);
+	}
+	gBS->RestoreTPL(OldTpl);
+
+	return EFI_SUCCESS;
+}
+
+static WRAPPER *FindWrapper(EFI_HANDLE Handle)
+{
+	LIST_ENTRY *Link;
+
+	for (Link = GetFirstNode(&wrappers); !IsNull(&wrappers, Link);
+		Link = GetNextNode(&wrappers, Link))
+	{
+		WRAPPER *w = WRAPPER_FROM_LINK(Link);
+
+		if (w->stats.Handle == Handle)
+			return w;
+	}
+
+	return NULL;
+}
+
+/* replace the protocol of a reader by a wrapper, only once per reader */
+static void Wrap(EFI_HANDLE Handle)
+{
+	EFI_STATUS Status;
+	EFI_SMART_CARD_READER_PROTOCOL *Original;
+	UINTN ReaderNameLength;
+	WRAPPER *w;
+
+	if (FindWrapper(Handle))
+		return;
+
+	Status = gBS->HandleProtocol(Handle, &gEfiSmartCardReaderProtocolGuid,
+		(VOID **)&Original);
+	if (EFI_ERROR(Status))
+		return;
+
+	w = AllocateZeroPool(sizeof *w);
+	if (NULL == w)
+		return;
+
+	w->Signature = WRAPPER_SIGNATURE;
+	w->SmartCardReader.SCardConnect = WrapperConnect;
+	w->SmartCardReader.SCardDisconnect = WrapperDisconnect;
+	w->SmartCardReader.SCardStatus = WrapperStatus;
+	w->SmartCardReader.SCardTransmit = WrapperTransmit;
+	w->SmartCardReader.SCardControl = WrapperControl;
+	w->SmartCardReader.SCardGetAttrib = WrapperGetAttrib;
+	w->Original = Original;
+	InitializeSpinLock(&w->lock);
+	w->stats.Handle = Handle;
+
+	ReaderNameLength = sizeof w->stats.ReaderName;
+	Original->SCardStatus(Original, w->stats.ReaderName, &ReaderNameLength,
+		NULL, NULL, NULL, NULL);
+
+	/* the wrapper is known before the notification of the reinstall */
+	w->stats.index = nb_wrappers++;
+	InsertTailList(&wrappers, &w->Link);
+
+	Status = gBS->ReinstallProtocolInterface(Handle,
+		&gEfiSmartCardReaderProtocolGuid, Original, &w->SmartCardReader);
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: reader %d: %r\n", w->stats.index, Status);
+		RemoveEntryList(&w->Link);
+		nb_wrappers--;
+		FreePool(w);
+	}
+}
+
+/* a reader driver was loaded after us */
+static VOID EFIAPI ReaderNotify(IN EFI_EVENT Event, IN VOID *Context)
+{
+	EFI_HANDLE Handle;
+	UINTN Size;
+
+	for (;;)
+	{
+		Size = sizeof Handle;
+		if (EFI_ERROR(gBS->LocateHandle(ByRegisterNotify, NULL, Registration,
+			&Size, &Handle)))
+			break;
+
+		Wrap(Handle);
+	}
+}
+
+static EFI_STATUS EFIAPI ReaderStatsUnload(IN EFI_HANDLE ImageHandle)
+{
+	LIST_ENTRY *Link;
+	EFI_SMART_CARD_READER_PROTOCOL *Current;
+
+	/* a driver loaded over us still uses our protocol */
+	for (Link = GetFirstNode(&wrappers); !IsNull(&wrappers, Link);
+		Link = GetNextNode(&wrappers, Link))
+	{
+		WRAPPER *w = WRAPPER_FROM_LINK(Link);
+
+		if (EFI_ERROR(gBS->HandleProtocol(w->stats.Handle,
+			&gEfiSmartCardReaderProtocolGuid, (VOID **)&Current))
+			|| (Current != &w->SmartCardReader))
+		{
+			Print(L"ERROR: reader %d is wrapped by another driver\n",
+				w->stats.index);
+			return EFI_ACCESS_DENIED;
+		}
+	}
+
+	gBS->CloseEvent(NotifyEvent);
+	gBS->UninstallProtocolInterface(StatsHandle, &gReaderStatsProtocolGuid,
+		&ReaderStats);
+
+	while (!IsListEmpty(&wrappers))
+	{
+		WRAPPER *w = WRAPPER_FROM_LINK(GetFirstNode(&wrappers));
+
+		gBS->ReinstallProtocolInterface(w->stats.Handle,
+			&gEfiSmartCardReaderProtocolGuid, &w->SmartCardReader,
+			w->Original);
+		RemoveEntryList(&w->Link);
+		FreePool(w);
+	}
+	nb_wrappers = 0;
+
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS EFIAPI ReaderStatsEntryPoint(
+	IN EFI_HANDLE ImageHandle,
+	IN EFI_SYSTEM_TABLE *SystemTable)
+{
+	EFI_STATUS Status;
+	EFI_LOADED_IMAGE_PROTOCOL *LoadedImage;
+	EFI_HANDLE *Handles = NULL;
+	UINTN HandleCount = 0, i;
+
+	Status = gBS->HandleProtocol(ImageHandle, &gEfiLoadedImageProtocolGuid,
+		(VOID **)&LoadedImage);
+	if (EFI_ERROR(Status))
+		return Status;
+
+	StopwatchInit();
+
+	ReaderStats.Revision = READER_STATS_REVISION;
+	ReaderStats.GetStats = GetStats;
+	ReaderStats.Reset = ResetStats;
+	StatsHandle = ImageHandle;
+	Status = gBS->InstallProtocolInterface(&StatsHandle,
+		&gReaderStatsProtocolGuid, EFI_NATIVE_INTERFACE, &ReaderStats);
+	if (EFI_ERROR(Status))
+		return Status;
+
+	/* the readers already installed */
+	Status = gBS->LocateHandleBuffer(ByProtocol,
+		&gEfiSmartCardReaderProtocolGuid, NULL, &HandleCount, &Handles);
+	if (!EFI_ERROR(Status))
+	{
+		for (i=0; i<HandleCount; i++)
+			Wrap(Handles[i]);
+		FreePool(Handles);
+	}
+
+	/* and the next ones */
+	Status = gBS->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_CALLBACK, ReaderNotify,
+		NULL, &NotifyEvent);
+	if (!EFI_ERROR(Status))
+		Status = gBS->RegisterProtocolNotify(&gEfiSmartCardReaderProtocolGuid,
+			NotifyEvent, &Registration);
+	if (EFI_ERROR(Status))
+		Print(L"WARNING: readers added later are not wrapped: %r\n", Status);
+
+	Print(L"%d reader(s) wrapped\n", nb_wrappers);
+
+	LoadedImage->Unload = ReaderStatsUnload;
+
+	return EFI_SUCCESS;
+}
@@ -0,0 +1,256 @@
+/*
+    Timing.c: ISO 7816-3 timing model of the virtual reader
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * The model counts the characters exchanged on the card interface for
+ * one APDU:
+ * - T=0: TPDU headers, procedure bytes, status words, ENVELOPE for
+ *   extended commands and GET RESPONSE for the response data
+ * - T=1: I-blocks of IFSC/IFSD bytes, R-blocks acknowledging chained
+ *   blocks and the block guard time between blocks
+ * A character lasts 12 etu plus the extra guard time N (11 etu for
+ * T=1 with N = 255). While the card works it sends a NULL procedure
+ * byte every WT (T=0) or a WTX request every BWT (T=1).
+ */
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Protocol/SmartCardReader.h>
+
+#include "Timing.h"
+
+/* ISO 7816-3 table 7: Fi and f(max) indexed by FI */
+static CONST UINT32 fi_table[16] = { 372, 372, 558, 744, 1116, 1488, 1860,
+	0, 0, 512, 768, 1024, 1536, 2048, 0, 0 };
+static CONST UINT32 fmax_table[16] = { 4000000, 5000000, 6000000, 8000000,
+	12000000, 16000000, 20000000, 0, 0, 5000000, 7500000, 10000000,
+	15000000, 20000000, 0, 0 };
+
+/* ISO 7816-3 table 8: Di indexed by DI */
+static CONST UINT32 di_table[16] = { 0, 1, 2, 4, 8, 16, 32, 64, 12, 20,
+	0, 0, 0, 0, 0, 0 };
+
+/* T=1 block guard time, in etu */
+#define BGT 22
+
+/* T=1 prologue (NAD PCB LEN) and epilogue (LRC) */
+#define T1_OVERHEAD 4
+
+/* T=0 TPDU header, procedure byte and status word */
+#define T0_OVERHEAD (5 + 1 + 2)
+
+void TimingFromAtr(TIMING *t, CONST UINT8 *Atr, UINTN AtrLength, UINT32 clock)
+{
+	UINTN i, level;
+	UINT8 y, td;
+	int previous_T = 0;
+	BOOLEAN t1_parameters = FALSE;
+	UINT32 fmax = fmax_table[1];
+
+	ZeroMem(t, sizeof *t);
+	t->f = clock ? clock : DEFAULT_CLOCK;
+	t->Fi = 372;
+	t->Di = 1;
+	t->WI = 10;
+	t->BWI = 4;
+	t->CWI = 13;
+	t->IFSC = 32;
+	t->IFSD = DEFAULT_IFSD;
+
+	if (AtrLength < 2)
+	{
+		t->protocols = SCARD_PROTOCOL_T0;
+		return;
+	}
+
+	/* format byte T0 */
+	y = Atr[1] >> 4;
+	i = 2;
+	for (level = 1; ; level++)
+	{
+		UINT8 ta = 0, tb = 0, tc = 0;
+		BOOLEAN has_ta, has_tb, has_tc, has_td;
+
+		has_ta = (y & 1) && (i < AtrLength);
+		if (has_ta)
+			ta = Atr[i++];
+		has_tb = (y & 2) && (i < AtrLength);
+		if (has_tb)
+			tb = Atr[i++];
+		has_tc = (y & 4) && (i < AtrLength);
+		if (has_tc)
+			tc = Atr[i++];
+		has_td = (y & 8) && (i < AtrLength);
+		td = has_td ? Atr[i++] : 0;
+
+		if (1 == level)
+		{
+			if (has_ta && fi_table[ta >> 4] && di_table[ta & 0x0F])
+			{
+				t->Fi = fi_table[ta >> 4];
+				t->Di = di_table[ta & 0x0F];
+				fmax = fmax_table[ta >> 4];
+			}
+			if (has_tc)
+				t->N = tc;
+		}
+
+		if ((2 == level) && has_tc && tc)
+			t->WI = tc;
+
+		/* first T=1 specific interface bytes */
+		if ((level >= 3) && (1 == previous_T) && !t1_parameters)
+		{
+			if (has_ta && ta)
+				t->IFSC = ta;
+			if (has_tb)
+			{
+				t->BWI = tb >> 4;
+				t->CWI = tb & 0x0F;
+			}
+			t1_parameters = TRUE;
+		}
+
+		if (!has_td)
+			break;
+
+		previous_T = td & 0x0F;
+		if (0 == previous_T)
+			t->protocols |= SCARD_PROTOCOL_T0;
+		if (1 == previous_T)
+			t->protocols |= SCARD_PROTOCOL_T1;
+		y = td >> 4;
+	}
+
+	/* no TD1: T=0 only */
+	if (0 == t->protocols)
+		t->protocols = SCARD_PROTOCOL_T0;
+
+	if (t->f > fmax)
+		t->f = fmax;
+}
+
+UINT64 TimingEtu(CONST TIMING *t)
+{
+	return DivU64x64Remainder(MultU64x32(1000000000000ULL, t->Fi),
+		(UINT64)t->Di * t->f, NULL);
+}
+
+/* T=0: GET RESPONSE commands of up to 256 bytes */
+static UINT64 t0_get_response(UINTN length)
+{
+	UINTN n = (length + 255) / 256;
+
+	return n * T0_OVERHEAD + length;
+}
+
+UINT64 TimingExchange(CONST TIMING *t, UINT32 protocol,
+	CONST UINT8 *CAPDU, UINTN CAPDULength, UINTN RAPDULength,
+	UINT64 processing_ns)
+{
+	UINT64 etu_ps = TimingEtu(t);
+	UINT64 chars, extra = 0, processing_etu, waits;
+	UINTN char_etu, data;
+	BOOLEAN t1 = (SCARD_PROTOCOL_T1 == protocol);
+
+	if (255 == t->N)
+		char_etu = t1 ? 11 : 12;
+	else
+		char_etu = 12 + t->N;
+
+	processing_etu = DivU64x64Remainder(MultU64x32(processing_ns, 1000),
+		etu_ps, NULL);
+
+	/* response data, without the status word */
+	data = (RAPDULength > 2) ? RAPDULength - 2 : 0;
+
+	if (t1)
+	{
+		UINTN n_cmd = (CAPDULength + t->IFSC - 1) / t->IFSC;
+		UINTN n_resp = (RAPDULength + t->IFSD - 1) / t->IFSD;
+		UINT64 bwt;
+
+		if (0 == n_cmd)
+			n_cmd = 1;
+		if (0 == n_resp)
+			n_resp = 1;
+
+		/* I-blocks, and an R-block for each chained I-block */
+		chars = CAPDULength + n_cmd * T1_OVERHEAD + (n_cmd - 1) * T1_OVERHEAD
+			+ RAPDULength + n_resp * T1_OVERHEAD + (n_resp - 1) * T1_OVERHEAD;
+
+		/* direction changes between blocks */
+		if (BGT > char_etu)
+			extra += (2*n_cmd - 1 + 2*n_resp - 1) * (BGT - char_etu);
+
+		/* BWT = 11 etu + 2^BWI x 960 x 372 / f */
+		bwt = 11 + DivU64x64Remainder(
+			MultU64x32(LShiftU64(960 * 372, t->BWI), t->Di), t->Fi, NULL);
+
+		/* S(WTX request) and S(WTX response) for each BWT */
+		waits = DivU64x64Remainder(processing_etu, bwt, NULL);
+		chars += waits * 2 * (T1_OVERHEAD + 1);
+		if (BGT > char_etu)
+			extra += waits * 2 * (BGT - char_etu);
+	}
+	else
+	{
+		BOOLEAN extended = (CAPDULength > 5) && (0 == CAPDU[4]);
+		UINT64 wt;
+
+		if (extended)
+		{
+			/* ENVELOPE commands of up to 255 bytes */
+			UINTN n = (CAPDULength + 254) / 255;
+
+			chars = n * T0_OVERHEAD + CAPDULength;
+			if (data)
+				chars += t0_get_response(data);
+		}
+		else
+		{
+			UINTN lc = (CAPDULength > 5) ? CAPDU[4] : 0;
+
+			/* header and status word */
+			chars = 5 + 2;
+			if (lc)
+				chars += 1 + lc;
+			if (data)
+			{
+				if (lc)
+					/* Case 4: 61xx then GET RESPONSE */
+					chars += t0_get_response(data);
+				else
+					/* Case 2: procedure byte and data */
+					chars += 1 + data;
+			}
+		}
+
+		/* WT = WI x 960 x Fi / f */
+		wt = MultU64x32(960 * t->WI, t->Di);
+
+		/* a NULL procedure byte for each WT */
+		waits = DivU64x64Remainder(processing_etu, wt, NULL);
+		chars += waits;
+	}
+
+	return DivU64x64Remainder(MultU64x64(chars * char_etu + extra, etu_ps),
+		1000, NULL) + processing_ns;
+}
@@ -0,0 +1,61 @@
+/*
+    Timing.h: ISO 7816-3 timing model of the virtual reader
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+/* default card clock of the reader, in Hz */
+#define DEFAULT_CLOCK 4000000
+
+/* IFSD announced by the reader */
+#define DEFAULT_IFSD 254
+
+/* timing parameters of a card, from its ATR */
+typedef struct
+{
+	UINT32 f;			/**< card clock, in Hz */
+	UINT32 Fi;			/**< clock rate conversion integer */
+	UINT32 Di;			/**< baud rate adjustment integer */
+	UINT32 N;			/**< extra guard time, TC1 */
+	UINT32 protocols;	/**< SCARD_PROTOCOL_T0 and/or SCARD_PROTOCOL_T1 */
+	UINT32 WI;			/**< T=0 waiting time integer, TC2 */
+	UINT32 BWI;			/**< T=1 block waiting time integer, TB3 */
+	UINT32 CWI;			/**< T=1 character waiting time integer, TB3 */
+	UINT32 IFSC;		/**< T=1 information field size of the card, TA3 */
+	UINT32 IFSD;		/**< T=1 information field size of the reader */
+} TIMING;
+
+/* get the parameters from the ATR; clock is 0 for DEFAULT_CLOCK */
+void TimingFromAtr(TIMING *t, CONST UINT8 *Atr, UINTN AtrLength, UINT32 clock);
+
+/* duration of one etu, in picoseconds */
+UINT64 TimingEtu(CONST TIMING *t);
+
+/*
+ * Duration, in nanoseconds, of the exchange of an APDU of CAPDULength
+ * bytes and its RAPDULength bytes response using protocol, with the
+ * card working for processing_ns nanoseconds. The waiting time
+ * extensions (T=1) or NULL procedure bytes (T=0) sent during the card
+ * processing are included.
+ */
+UINT64 TimingExchange(CONST TIMING *t, UINT32 protocol,
+	CONST UINT8 *CAPDU, UINTN CAPDULength, UINTN RAPDULength,
+	UINT64 processing_ns);
+
+#endif
@@ -0,0 +1,495 @@
+/*
+    VirtualCard.c: software smart card with the test applet
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* The card implements the commands sent by valid_SmartCardReader,
+ * scardcontrol, HelloWorld and SmartCardReader_Appl. */
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "VirtualCard.h"
+
+/* JCOP v2.4.1 offering T=0 (TD1) and T=1 (TD2) */
+CONST UINT8 VirtualCardAtr[] = {
+	0x3B, 0xF8, 0x13, 0x00, 0x00, 0x80, 0x31, 0xFE, 0x45,
+	0x4A, 0x43, 0x4F, 0x50, 0x76, 0x32, 0x34, 0x31, 0xB6 };
+CONST UINTN VirtualCardAtrLength = sizeof VirtualCardAtr;
+
+static CONST UINT8 test_aid[] = { 0xA0, 0x00, 0x00, 0x00, 0x18 };
+static CONST UINT8 hello_aid[] = { 0xA0, 0x00, 0x00, 0x00, 0x62, 0x03,
+	0x01, 0x0C, 0x06, 0x01 };
+static CONST char hello[] = "Hello world!";
+
+/* status words */
+#define SW_OK 0x9000
+#define SW_WRONG_LENGTH 0x6700
+#define SW_LAST_COMMAND_EXPECTED 0x6883
+#define SW_CONDITIONS_NOT_SATISFIED 0x6985
+#define SW_FILE_NOT_FOUND 0x6A82
+#define SW_WRONG_P1P2 0x6B00
+#define SW_INS_NOT_SUPPORTED 0x6D00
+#define SW_CLA_NOT_SUPPORTED 0x6E00
+#define SW_BYTES_AVAILABLE(n) (0x6100 | ((n) & 0xFF))
+#define SW_WRONG_LE(n) (0x6C00 | ((n) & 0xFF))
+
+/* a parsed command APDU */
+typedef struct
+{
+	UINT8 cla, ins, p1, p2;
+	UINT32 lc;			/**< 0 if no data */
+	CONST UINT8 *data;
+	UINT32 le;			/**< 0 if no Le, 256 or 65536 for Le = 0 */
+} APDU;
+
+/* ISO 7816-4 short and extended cases 1 to 4 */
+static int parse(CONST UINT8 *c, UINTN length, APDU *a)
+{
+	ZeroMem(a, sizeof *a);
+
+	if (length < 4)
+		return -1;
+
+	a->cla = c[0];
+	a->ins = c[1];
+	a->p1 = c[2];
+	a->p2 = c[3];
+
+	/* Case 1 */
+	if (4 == length)
+		return 0;
+
+	/* Case 2 short, or Case 1 TPDU with P3 = 0 */
+	if (5 == length)
+	{
+		a->le = c[4] ? c[4] : 256;
+		return 0;
+	}
+
+	if (c[4])
+	{
+		/* Case 3 and 4 short */
+		a->lc = c[4];
+		a->data = c + 5;
+		if (length == 5 + a->lc)
+			return 0;
+		if (length == 6 + a->lc)
+		{
+			a->le = c[5 + a->lc] ? c[5 + a->lc] : 256;
+			return 0;
+		}
+		return -1;
+	}
+
+	/* Case 2 extended */
+	if (7 == length)
+	{
+		a->le = (c[5] << 8) | c[6];
+		if (0 == a->le)
+			a->le = 65536;
+		return 0;
+	}
+
+	if (length < 7)
+		return -1;
+
+	/* Case 3 and 4 extended */
+	a->lc = (c[5] << 8) | c[6];
+	a->data = c + 7;
+	if (0 == a->lc)
+		return -1;
+	if (length == 7 + a->lc)
+		return 0;
+	if (length == 9 + a->lc)
+	{
+		a->le = (c[7 + a->lc] << 8) | c[8 + a->lc];
+		if (0 == a->le)
+			a->le = 65536;
+		return 0;
+	}
+
+	return -1;
+}
+
+/* check the room in the response buffer and add the status word */
+static EFI_STATUS reply(UINT8 *RAPDU, UINTN *RAPDULength, UINTN length,
+	UINT16 sw)
+{
+	if (*RAPDULength < length + 2)
+	{
+		*RAPDULength = length + 2;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+
+	RAPDU[length] = sw >> 8;
+	RAPDU[length+1] = sw;
+	*RAPDULength = length + 2;
+
+	return EFI_SUCCESS;
+}
+
+/* length bytes 00 01 02 ... as expected by valid_SmartCardReader */
+static void pattern(UINT8 *buffer, UINTN length)
+{
+	UINTN i;
+
+	for (i=0; i<length; i++)
+		buffer[i] = i;
+}
+
+static EFI_STATUS select_aid(VIRTUAL_CARD *Card, APDU *a,
+	UINT8 *RAPDU, UINTN *RAPDULength)
+{
+	Card->response_length = 0;
+
+	if ((a->p1 != 0x04) || (a->p2 != 0x00))
+		return reply(RAPDU, RAPDULength, 0, SW_WRONG_P1P2);
+
+	/* the last byte of the test AID is FF or 50 (COMBI) */
+	if ((a->lc == sizeof test_aid + 1)
+		&& (0 == CompareMem(a->data, test_aid, sizeof test_aid)))
+	{
+		Card->applet = APPLET_TEST;
+		return reply(RAPDU, RAPDULength, 0, SW_OK);
+	}
+
+	if ((a->lc == sizeof hello_aid)
+		&& (0 == CompareMem(a->data, hello_aid, sizeof hello_aid)))
+	{
+		Card->applet = APPLET_HELLO;
+		return reply(RAPDU, RAPDULength, 0, SW_OK);
+	}
+
+	return reply(RAPDU, RAPDULength, 0, SW_FILE_NOT_FOUND);
+}
+
+/* up to le bytes of the pending response, 61xx if more is left */
+static EFI_STATUS send_pending(VIRTUAL_CARD *Card, UINTN le,
+	UINT8 *RAPDU, UINTN *RAPDULength)
+{
+	UINTN length = (le < Card->pending) ? le : Card->pending;
+	UINTN left = Card->pending - length;
+
+	if (*RAPDULength < length + 2)
+		return reply(RAPDU, RAPDULength, length, SW_OK);
+
+	SetMem(RAPDU, length, Card->pending_value);
+	Card->pending = left;
+
+	/* 6100 for 256 bytes or more */
+	return reply(RAPDU, RAPDULength, length,
+		left ? SW_BYTES_AVAILABLE(left > 255 ? 0 : left) : SW_OK);
+}
+
+static EFI_STATUS get_response(VIRTUAL_CARD *Card, APDU *a,
+	UINT8 *RAPDU, UINTN *RAPDULength)
+{
+	UINTN length = Card->response_length;
+
+	if (Card->pending)
+		return send_pending(Card, a->le ? a->le : 256, RAPDU, RAPDULength);
+
+	if (0 == length)
+		return reply(RAPDU, RAPDULength, 0, SW_CONDITIONS_NOT_SATISFIED);
+
+	if (a->le != length)
+		return reply(RAPDU, RAPDULength, 0, SW_WRONG_LE(length));
+
+	if (*RAPDULength >= length + 2)
+	{
+		CopyMem(RAPDU, Card->response, length);
+		Card->response_length = 0;
+	}
+
+	return reply(RAPDU, RAPDULength, length, SW_OK);
+}
+
+static EFI_STATUS hello_applet(VIRTUAL_CARD *Card, APDU *a,
+	UINT8 *RAPDU, UINTN *RAPDULength)
+{
+	UINTN length = sizeof hello - 1;
+
+	if ((a->cla != 0x00) || (a->ins != 0x00))
+		return reply(RAPDU, RAPDULength, 0, SW_INS_NOT_SUPPORTED);
+
+	if (*RAPDULength >= length + 2)
+		CopyMem(RAPDU, hello, length);
+
+	return reply(RAPDU, RAPDULength, length, SW_OK);
+}
+
+static EFI_STATUS test_applet(VIRTUAL_CARD *Card, APDU *a,
+	UINT8 *RAPDU, UINTN *RAPDULength)
+{
+	UINTN length = (a->p1 << 8) | a->p2;
+	UINTN offset;
+
+	if (0x80 == a->cla)
+		switch (a->ins)
+		{
+			/* Case 1 and Case 3 */
+			case 0x30:
+			case 0x32:
+			case 0x12:
+				return reply(RAPDU, RAPDULength, 0, SW_OK);
+
+			/* Case 2: P1 P2 bytes */
+			case 0x34:
+				if (length > 256)
+					return reply(RAPDU, RAPDULength, 0, SW_WRONG_P1P2);
+				if (*RAPDULength >= length + 2)
+					pattern(RAPDU, length);
+				return reply(RAPDU, RAPDULength, length, SW_OK);
+
+			/* Case 2 with Le checked */
+			case 0x3C:
+				if (length > 256)
+					return reply(RAPDU, RAPDULength, 0, SW_WRONG_P1P2);
+				if (a->le != length)
+					return reply(RAPDU, RAPDULength, 0, SW_WRONG_LE(length));
+				if (*RAPDULength >= length + 2)
+					pattern(RAPDU, length);
+				return reply(RAPDU, RAPDULength, length, SW_OK);
+
+			/* Case 4: P1 P2 bytes, with 61xx if no Le (TPDU) */
+			case 0x36:
+				if (length > 256)
+					return reply(RAPDU, RAPDULength, 0, SW_WRONG_P1P2);
+				if (0 == a->le)
+				{
+					pattern(Card->response, length);
+					Card->response_length = length;
+					return reply(RAPDU, RAPDULength, 0,
+						SW_BYTES_AVAILABLE(length));
+				}
+				if (*RAPDULength >= length + 2)
+					pattern(RAPDU, length);
+				return reply(RAPDU, RAPDULength, length, SW_OK);
+
+			/* Case 4: Lc = 2, Data = length: length bytes of value P2,
+			 * Le at a time, the rest with GET RESPONSE */
+			case 0x02:
+				if (2 != a->lc)
+					return reply(RAPDU, RAPDULength, 0, SW_WRONG_LENGTH);
+				Card->response_length = 0;
+				Card->pending = (a->data[0] << 8) | a->data[1];
+				Card->pending_value = a->p2;
+				return send_pending(Card, a->le ? a->le : 256,
+					RAPDU, RAPDULength);
+
+			/* Time request: work P2 seconds */
+			case 0x38:
+				Card->processing_ns = MultU64x32(1000000000, a->p2);
+				return reply(RAPDU, RAPDULength, 0, SW_OK);
+
+			/* extended Case 2: Le bytes of value P2 */
+			case 0x00:
+				if (0 == a->le)
+					return reply(RAPDU, RAPDULength, 0, SW_WRONG_LENGTH);
+				if (*RAPDULength >= a->le + 2)
+					SetMem(RAPDU, a->le, a->p2);
+				return reply(RAPDU, RAPDULength, a->le, SW_OK);
+
+			case 0xC0:
+				return get_response(Card, a, RAPDU, RAPDULength);
+		}
+
+	if (0x00 == a->cla)
+		switch (a->ins)
+		{
+			/* VERIFY and CHANGE REFERENCE DATA: keep the PIN */
+			case 0x20:
+			case 0x24:
+				if (a->lc > sizeof Card->pin)
+					return reply(RAPDU, RAPDULength, 0, SW_WRONG_LENGTH);
+				CopyMem(Card->pin, a->data, a->lc);
+				Card->pin_length = a->lc;
+				return reply(RAPDU, RAPDULength, 0, SW_OK);
+
+			/* dump the last PIN command */
+			case 0x40:
+				if (a->le != Card->pin_length)
+					return reply(RAPDU, RAPDULength, 0,
+						SW_WRONG_LE(Card->pin_length));
+				if (*RAPDULength >= Card->pin_length + 2)
+					CopyMem(RAPDU, Card->pin, Card->pin_length);
+				return reply(RAPDU, RAPDULength, Card->pin_length, SW_OK);
+
+			/* UPDATE BINARY */
+			case 0xD6:
+				offset = length;
+				if (offset + a->lc > VIRTUAL_CARD_FILE_SIZE)
+					return reply(RAPDU, RAPDULength, 0, SW_WRONG_P1P2);
+				CopyMem(Card->file + offset, a->data, a->lc);
+				return reply(RAPDU, RAPDULength, 0, SW_OK);
+
+			/* READ BINARY */
+			case 0xB0:
+				offset = length;
+				if (offset + a->le > VIRTUAL_CARD_FILE_SIZE)
+					return reply(RAPDU, RAPDULength, 0, SW_WRONG_P1P2);
+				if (*RAPDULength >= a->le + 2)
+					CopyMem(RAPDU, Card->file + offset, a->le);
+				return reply(RAPDU, RAPDULength, a->le, SW_OK);
+
+			case 0xC0:
+				return get_response(Card, a, RAPDU, RAPDULength);
+		}
+
+	if ((0x00 != a->cla) && (0x80 != a->cla))
+		return reply(RAPDU, RAPDULength, 0, SW_CLA_NOT_SUPPORTED);
+
+	return reply(RAPDU, RAPDULength, 0, SW_INS_NOT_SUPPORTED);
+}
+
+EFI_STATUS VirtualCardInit(VIRTUAL_CARD *Card)
+{
+	ZeroMem(Card, sizeof *Card);
+
+	Card->file = AllocateZeroPool(VIRTUAL_CARD_FILE_SIZE);
+	Card->chain = AllocatePool(VIRTUAL_CARD_CHAIN_SIZE);
+	if ((NULL == Card->file) || (NULL == Card->chain))
+	{
+		VirtualCardFree(Card);
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	VirtualCardReset(Card);
+
+	return EFI_SUCCESS;
+}
+
+void VirtualCardFree(VIRTUAL_CARD *Card)
+{
+	if (Card->file)
+		FreePool(Card->file);
+	if (Card->chain)
+		FreePool(Card->chain);
+	Card->file = Card->chain = NULL;
+}
+
+void VirtualCardReset(VIRTUAL_CARD *Card)
+{
+	/* the test applet is the default selected applet */
+	Card->applet = APPLET_TEST;
+	Card->response_length = 0;
+	Card->chain_length = 0;
+	Card->pending = 0;
+}
+
+/*
+ * ISO 7816-4 command chaining: CLA b5 is set on all the commands of the
+ * chain but the last one. The data of the chain is collected and the
+ * last command is processed as one extended APDU with all the data.
+ * Return TRUE if a is ready to be processed.
+ */
+static BOOLEAN chain(VIRTUAL_CARD *Card, APDU *a,
+	UINT8 *RAPDU, UINTN *RAPDULength, EFI_STATUS *Status)
+{
+	UINT8 *c = Card->chain;
+	UINTN length;
+
+	if (!(a->cla & 0x10) && (0 == Card->chain_length))
+		return TRUE;
+
+	if (Card->chain_length && (a->ins != Card->chain_ins))
+	{
+		Card->chain_length = 0;
+		*Status = reply(RAPDU, RAPDULength, 0, SW_LAST_COMMAND_EXPECTED);
+		return FALSE;
+	}
+
+	if (Card->chain_length + a->lc > VIRTUAL_CARD_FILE_SIZE - 1)
+	{
+		Card->chain_length = 0;
+		*Status = reply(RAPDU, RAPDULength, 0, SW_WRONG_LENGTH);
+		return FALSE;
+	}
+
+	CopyMem(c + 7 + Card->chain_length, a->data, a->lc);
+	Card->chain_length += a->lc;
+	Card->chain_ins = a->ins;
+
+	if (a->cla & 0x10)
+	{
+		*Status = reply(RAPDU, RAPDULength, 0, SW_OK);
+		return FALSE;
+	}
+
+	/* last command: CLA INS P1 P2 00 Lc1 Lc2 Data [Le1 Le2] */
+	c[0] = a->cla;
+	c[1] = a->ins;
+	c[2] = a->p1;
+	c[3] = a->p2;
+	c[4] = 0;
+	c[5] = Card->chain_length >> 8;
+	c[6] = Card->chain_length;
+	length = 7 + Card->chain_length;
+	if (a->le)
+	{
+		/* 65536 is coded 00 00 */
+		c[length++] = a->le >> 8;
+		c[length++] = a->le;
+	}
+	Card->chain_length = 0;
+
+	if (parse(c, length, a))
+	{
+		*Status = reply(RAPDU, RAPDULength, 0, SW_WRONG_LENGTH);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+EFI_STATUS VirtualCardProcess(VIRTUAL_CARD *Card,
+	CONST UINT8 *CAPDU, UINTN CAPDULength,
+	UINT8 *RAPDU, UINTN *RAPDULength)
+{
+	APDU a;
+	EFI_STATUS Status;
+
+	Card->processing_ns = 0;
+
+	if (parse(CAPDU, CAPDULength, &a))
+		return reply(RAPDU, RAPDULength, 0, SW_WRONG_LENGTH);
+
+	if (!chain(Card, &a, RAPDU, RAPDULength, &Status))
+		return Status;
+
+	/* the rest of a response is lost if not asked for at once */
+	if (0xC0 != a.ins)
+		Card->pending = 0;
+
+	/* SELECT by AID */
+	if ((0x00 == a.cla) && (0xA4 == a.ins))
+		return select_aid(Card, &a, RAPDU, RAPDULength);
+
+	switch (Card->applet)
+	{
+		case APPLET_TEST:
+			return test_applet(Card, &a, RAPDU, RAPDULength);
+
+		case APPLET_HELLO:
+			return hello_applet(Card, &a, RAPDU, RAPDULength);
+	}
+
+	return reply(RAPDU, RAPDULength, 0, SW_CONDITIONS_NOT_SATISFIED);
+}
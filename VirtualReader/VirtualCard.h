@@ -0,0 +1,66 @@
+/*
+    VirtualCard.h: software smart card with the test applet
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __VIRTUALCARD_H__
+#define __VIRTUALCARD_H__
+
+/* applets of the virtual card */
+#define APPLET_NONE 0
+#define APPLET_TEST 1	/**< A0 00 00 00 18 FF (or 50 for COMBI) */
+#define APPLET_HELLO 2	/**< A0 00 00 00 62 03 01 0C 06 01 */
+
+/* size of the binary file used by READ BINARY and UPDATE BINARY */
+#define VIRTUAL_CARD_FILE_SIZE (1<<16)
+
+/* room for a command built from chained commands: header, Lc, data, Le */
+#define VIRTUAL_CARD_CHAIN_SIZE (4 + 3 + (1<<16) + 2)
+
+/* state of one virtual card */
+typedef struct
+{
+	int applet;			/**< selected applet */
+	UINT8 response[256];	/**< data waiting for a GET RESPONSE */
+	UINTN response_length;
+	UINT8 pin[64];		/**< data of the last VERIFY or CHANGE REFERENCE DATA */
+	UINTN pin_length;
+	UINT8 *file;		/**< VIRTUAL_CARD_FILE_SIZE bytes binary file */
+	UINT8 *chain;		/**< extended APDU built from the chained commands */
+	UINTN chain_length;	/**< data received in the chained commands */
+	UINT8 chain_ins;	/**< INS of the chain */
+	UINTN pending;		/**< bytes of value pending_value left for GET RESPONSE */
+	UINT8 pending_value;
+	UINT64 processing_ns;	/**< time spent by the card on the last command */
+} VIRTUAL_CARD;
+
+extern CONST UINT8 VirtualCardAtr[];
+extern CONST UINTN VirtualCardAtrLength;
+
+EFI_STATUS VirtualCardInit(VIRTUAL_CARD *Card);
+void VirtualCardFree(VIRTUAL_CARD *Card);
+void VirtualCardReset(VIRTUAL_CARD *Card);
+
+/*
+ * Process one command APDU. This function uses no boot services so it
+ * can be called from an application processor.
+ */
+EFI_STATUS VirtualCardProcess(VIRTUAL_CARD *Card,
+	CONST UINT8 *CAPDU, UINTN CAPDULength,
+	UINT8 *RAPDU, UINTN *RAPDULength);
+
+#endif
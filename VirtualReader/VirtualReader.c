@@ -0,0 +1,687 @@
+/*
+    VirtualReader.c: EFI_SMART_CARD_READER_PROTOCOL backed by a software card
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Usage from the UEFI Shell:
+ * VirtualReader.efi [number of readers] [-t] [-f clock] [-a ATR] [-p us]
+ *  -t        delay each exchange following the timing model (Timing.c)
+ *  -f clock  card clock in Hz (default 4 MHz, limited by f(max) of TA1)
+ *  -a ATR    ATR of the cards, in hex, giving the timing parameters
+ *  -p us     processing time of the card for each command
+ * The driver stays resident and can be removed with "unload".
+ *
+ * The protocol functions use no boot services and no console output so
+ * the readers can be used in parallel from application processors, one
+ * reader per processor.
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
+#include <Protocol/SmartCardReader.h>
+#include <Protocol/LoadedImage.h>
+
+#define UEFI_DRIVER
+#include "../reader.h"
+
+#include "VirtualCard.h"
+#include "Timing.h"
+
+/* number of readers if none is given on the command line */
+#define DEFAULT_READERS 1
+#define MAX_READERS 16
+
+/* reported by SCARD_ATTR_MAXINPUT: dwMaxCCIDMessageLength - 10 */
+#define MAX_INPUT (4 + 3 + (1<<16) + 3)
+
+#define VIRTUAL_READER_SIGNATURE SIGNATURE_32('v', 's', 'c', 'r')
+
+typedef struct
+{
+	UINTN Signature;
+	EFI_SMART_CARD_READER_PROTOCOL SmartCardReader;
+	EFI_HANDLE Handle;
+	CHAR16 ReaderName[32];
+	BOOLEAN Connected;		/**< SCardConnect() done */
+	BOOLEAN Powered;		/**< the card has an ATR */
+	UINT32 ActiveProtocol;
+	VIRTUAL_CARD Card;
+	TIMING Timing;
+} VIRTUAL_READER;
+
+#define VIRTUAL_READER_FROM_THIS(a) \
+	CR(a, VIRTUAL_READER, SmartCardReader, VIRTUAL_READER_SIGNATURE)
+
+static VIRTUAL_READER *readers;
+static UINTN nb_readers;
+
+/* configuration from the command line */
+static BOOLEAN timed = FALSE;
+static UINT32 card_clock = 0;
+static UINT8 atr[33];
+static UINTN atr_length = 0;
+static UINT64 processing_ns = 0;
+
+/* IOCTL of a PC/SC v2 part 10 feature */
+#define FEATURE_IOCTL(feature) SCARD_CTL_CODE(3400 + (feature))
+
+static EFI_STATUS EFIAPI VirtualReaderConnect(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 AccessMode,
+	IN UINT32 CardAction,
+	IN UINT32 PreferredProtocols,
+	OUT UINT32 *ActiveProtocol)
+{
+	VIRTUAL_READER *Reader;
+
+	if ((NULL == This) || (NULL == ActiveProtocol))
+		return EFI_INVALID_PARAMETER;
+	Reader = VIRTUAL_READER_FROM_THIS(This);
+
+	if ((AccessMode != SCARD_AM_READER) && (AccessMode != SCARD_AM_CARD))
+		return EFI_INVALID_PARAMETER;
+
+	if (Reader->Connected)
+		return EFI_ACCESS_DENIED;
+
+	if (SCARD_AM_READER == AccessMode)
+	{
+		Reader->Connected = TRUE;
+		*ActiveProtocol = SCARD_PROTOCOL_UNDEFINED;
+		return EFI_SUCCESS;
+	}
+
+	/* protocols announced in the ATR */
+	PreferredProtocols &= Reader->Timing.protocols;
+	if (PreferredProtocols & SCARD_PROTOCOL_T1)
+		Reader->ActiveProtocol = SCARD_PROTOCOL_T1;
+	else
+		if (PreferredProtocols & SCARD_PROTOCOL_T0)
+			Reader->ActiveProtocol = SCARD_PROTOCOL_T0;
+		else
+			return EFI_UNSUPPORTED;
+
+	switch (CardAction)
+	{
+		case SCARD_CA_COLDRESET:
+		case SCARD_CA_WARMRESET:
+			VirtualCardReset(&Reader->Card);
+			Reader->Powered = TRUE;
+			break;
+
+		case SCARD_CA_NORESET:
+			if (!Reader->Powered)
+			{
+				VirtualCardReset(&Reader->Card);
+				Reader->Powered = TRUE;
+			}
+			break;
+
+		default:
+			return EFI_INVALID_PARAMETER;
+	}
+
+	Reader->Connected = TRUE;
+	*ActiveProtocol = Reader->ActiveProtocol;
+
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI VirtualReaderDisconnect(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 CardAction)
+{
+	VIRTUAL_READER *Reader;
+
+	if (NULL == This)
+		return EFI_INVALID_PARAMETER;
+	Reader = VIRTUAL_READER_FROM_THIS(This);
+
+	switch (CardAction)
+	{
+		case SCARD_CA_NORESET:
+			break;
+
+		case SCARD_CA_COLDRESET:
+		case SCARD_CA_WARMRESET:
+			VirtualCardReset(&Reader->Card);
+			break;
+
+		case SCARD_CA_UNPOWER:
+			Reader->Powered = FALSE;
+			break;
+
+		case SCARD_CA_EJECT:
+			return EFI_UNSUPPORTED;
+
+		default:
+			return EFI_INVALID_PARAMETER;
+	}
+
+	Reader->Connected = FALSE;
+
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI VirtualReaderStatus(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	OUT CHAR16 *ReaderName OPTIONAL,
+	IN OUT UINTN *ReaderNameLength OPTIONAL,
+	OUT UINT32 *State OPTIONAL,
+	OUT UINT32 *CardProtocol OPTIONAL,
+	OUT UINT8 *Atr OPTIONAL,
+	IN OUT UINTN *AtrLength OPTIONAL)
+{
+	VIRTUAL_READER *Reader;
+	UINTN NameSize;
+	EFI_STATUS Status = EFI_SUCCESS;
+
+	if (NULL == This)
+		return EFI_INVALID_PARAMETER;
+	Reader = VIRTUAL_READER_FROM_THIS(This);
+
+	if (State)
+		*State = Reader->Powered ? SCARD_ACTIVE : SCARD_INACTIVE;
+
+	if (CardProtocol)
+		*CardProtocol = Reader->Powered ? Reader->ActiveProtocol
+			: SCARD_PROTOCOL_UNDEFINED;
+
+	/* ReaderNameLength is in bytes */
+	if (ReaderNameLength)
+	{
+		NameSize = StrSize(Reader->ReaderName);
+		if (ReaderName && (*ReaderNameLength >= NameSize))
+			CopyMem(ReaderName, Reader->ReaderName, NameSize);
+		else
+			Status = EFI_BUFFER_TOO_SMALL;
+		*ReaderNameLength = NameSize;
+	}
+
+	if (AtrLength)
+	{
+		if (Atr && (*AtrLength >= atr_length))
+			CopyMem(Atr, atr, atr_length);
+		else
+			Status = EFI_BUFFER_TOO_SMALL;
+		*AtrLength = atr_length;
+	}
+
+	return Status;
+}
+
+static EFI_STATUS EFIAPI VirtualReaderTransmit(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT8 *CAPDU,
+	IN UINTN CAPDULength,
+	OUT UINT8 *RAPDU,
+	IN OUT UINTN *RAPDULength)
+{
+	VIRTUAL_READER *Reader;
+	EFI_STATUS Status;
+	UINT64 delay;
+
+	if ((NULL == This) || (NULL == CAPDU) || (0 == CAPDULength)
+		|| (NULL == RAPDU) || (NULL == RAPDULength))
+		return EFI_INVALID_PARAMETER;
+	Reader = VIRTUAL_READER_FROM_THIS(This);
+
+	if (!Reader->Connected || !Reader->Powered)
+		return EFI_NOT_READY;
+
+	Status = VirtualCardProcess(&Reader->Card, CAPDU, CAPDULength,
+		RAPDU, RAPDULength);
+	if (EFI_ERROR(Status))
+		return Status;
+
+	delay = Reader->Card.processing_ns + processing_ns;
+	if (timed)
+		delay = TimingExchange(&Reader->Timing, Reader->ActiveProtocol,
+			CAPDU, CAPDULength, *RAPDULength, delay);
+	if (delay)
+		MicroSecondDelay(DivU64x32(delay, 1000));
+
+	return EFI_SUCCESS;
+}
+
+/* replace the PIN placeholder in the APDU by the virtual PIN "1234" */
+static void insert_pin(UINT8 *apdu, UINTN apdu_length, UINTN offset)
+{
+	static CONST UINT8 pin[] = { '1', '2', '3', '4' };
+
+	/* bmFormatString 0x82: ASCII, left justified, PIN after Lc */
+	if (5 + offset + sizeof pin <= apdu_length)
+		CopyMem(apdu + 5 + offset, pin, sizeof pin);
+}
+
+static EFI_STATUS pin_command(VIRTUAL_READER *Reader, UINT8 *apdu,
+	UINTN apdu_length, UINTN offset_old, UINTN offset_new, BOOLEAN modify,
+	UINT8 *OutBuffer, UINTN *OutBufferLength)
+{
+	UINT8 command[5 + 255 + 1];
+
+	if (!Reader->Connected || !Reader->Powered)
+		return EFI_NOT_READY;
+
+	if ((apdu_length < 5) || (apdu_length > sizeof command))
+		return EFI_INVALID_PARAMETER;
+
+	CopyMem(command, apdu, apdu_length);
+	insert_pin(command, apdu_length, offset_old);
+	if (modify)
+		insert_pin(command, apdu_length, offset_new);
+
+	return VirtualCardProcess(&Reader->Card, command, apdu_length,
+		OutBuffer, OutBufferLength);
+}
+
+/* add a Tag Length Value with an integer value */
+static UINTN add_tlv(UINT8 *p, UINT8 tag, UINT8 length, UINT32 value)
+{
+	int i;
+
+	p[0] = tag;
+	p[1] = length;
+	for (i=0; i<length; i++)
+		p[2+i] = value >> (8*i);
+
+	return 2 + length;
+}
+
+static EFI_STATUS EFIAPI VirtualReaderControl(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 ControlCode,
+	IN UINT8 *InBuffer OPTIONAL,
+	IN UINTN InBufferLength OPTIONAL,
+	OUT UINT8 *OutBuffer OPTIONAL,
+	IN OUT UINTN *OutBufferLength OPTIONAL)
+{
+	static CONST UINT8 features[] = {
+		FEATURE_VERIFY_PIN_DIRECT,
+		FEATURE_MODIFY_PIN_DIRECT,
+		FEATURE_IFD_PIN_PROPERTIES,
+		FEATURE_GET_TLV_PROPERTIES,
+	};
+	static CONST char firmware[] = "Virtual";
+	VIRTUAL_READER *Reader;
+	UINT8 buffer[64];
+	UINTN length = 0, i;
+
+	if ((NULL == This) || (NULL == OutBufferLength)
+		|| ((NULL == OutBuffer) && *OutBufferLength))
+		return EFI_INVALID_PARAMETER;
+	Reader = VIRTUAL_READER_FROM_THIS(This);
+
+	switch (ControlCode)
+	{
+		case CM_IOCTL_GET_FEATURE_REQUEST:
+		{
+			PCSC_TLV_STRUCTURE *tlv = (PCSC_TLV_STRUCTURE *)buffer;
+
+			/* the applications of this package read the value in
+			 * host byte order */
+			for (i=0; i<ARRAY_SIZE(features); i++)
+			{
+				tlv[i].tag = features[i];
+				tlv[i].length = 4;
+				tlv[i].value = FEATURE_IOCTL(features[i]);
+			}
+			length = ARRAY_SIZE(features) * sizeof *tlv;
+			break;
+		}
+
+		case FEATURE_IOCTL(FEATURE_GET_TLV_PROPERTIES):
+			length += add_tlv(buffer + length,
+				PCSCv2_PART10_PROPERTY_wLcdLayout, 2, 0);
+			length += add_tlv(buffer + length,
+				PCSCv2_PART10_PROPERTY_bEntryValidationCondition, 1, 0x02);
+			length += add_tlv(buffer + length,
+				PCSCv2_PART10_PROPERTY_bTimeOut2, 1, 0);
+			length += add_tlv(buffer + length,
+				PCSCv2_PART10_PROPERTY_bMinPINSize, 1, 4);
+			length += add_tlv(buffer + length,
+				PCSCv2_PART10_PROPERTY_bMaxPINSize, 1, 8);
+			buffer[length++] = PCSCv2_PART10_PROPERTY_sFirmwareID;
+			buffer[length++] = sizeof firmware - 1;
+			CopyMem(buffer + length, firmware, sizeof firmware - 1);
+			length += sizeof firmware - 1;
+			length += add_tlv(buffer + length,
+				PCSCv2_PART10_PROPERTY_bPPDUSupport, 1, 0);
+			length += add_tlv(buffer + length,
+				PCSCv2_PART10_PROPERTY_dwMaxAPDUDataSize, 4, 1<<16);
+			/* pid.codes test VID/PID */
+			length += add_tlv(buffer + length,
+				PCSCv2_PART10_PROPERTY_wIdVendor, 2, 0x1209);
+			length += add_tlv(buffer + length,
+				PCSCv2_PART10_PROPERTY_wIdProduct, 2, 0x0001);
+			break;
+
+		case FEATURE_IOCTL(FEATURE_IFD_PIN_PROPERTIES):
+		{
+			PIN_PROPERTIES_STRUCTURE *pin_properties =
+				(PIN_PROPERTIES_STRUCTURE *)buffer;
+
+			pin_properties->wLcdLayout = 0;
+			pin_properties->bEntryValidationCondition = 0x02;
+			pin_properties->bTimeOut2 = 0;
+			length = sizeof *pin_properties;
+			break;
+		}
+
+		case FEATURE_IOCTL(FEATURE_VERIFY_PIN_DIRECT):
+		{
+			PIN_VERIFY_STRUCTURE *pin_verify = (PIN_VERIFY_STRUCTURE *)InBuffer;
+
+			if ((NULL == InBuffer) || (InBufferLength < sizeof *pin_verify)
+				|| (InBufferLength < sizeof *pin_verify + pin_verify->ulDataLength))
+				return EFI_INVALID_PARAMETER;
+
+			return pin_command(Reader, pin_verify->abData,
+				pin_verify->ulDataLength, 0, 0, FALSE,
+				OutBuffer, OutBufferLength);
+		}
+
+		case FEATURE_IOCTL(FEATURE_MODIFY_PIN_DIRECT):
+		{
+			PIN_MODIFY_STRUCTURE *pin_modify = (PIN_MODIFY_STRUCTURE *)InBuffer;
+
+			if ((NULL == InBuffer) || (InBufferLength < sizeof *pin_modify)
+				|| (InBufferLength < sizeof *pin_modify + pin_modify->ulDataLength))
+				return EFI_INVALID_PARAMETER;
+
+			return pin_command(Reader, pin_modify->abData,
+				pin_modify->ulDataLength, pin_modify->bInsertionOffsetOld,
+				pin_modify->bInsertionOffsetNew, TRUE,
+				OutBuffer, OutBufferLength);
+		}
+
+		default:
+			return EFI_UNSUPPORTED;
+	}
+
+	if (*OutBufferLength < length)
+	{
+		*OutBufferLength = length;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+
+	CopyMem(OutBuffer, buffer, length);
+	*OutBufferLength = length;
+
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI VirtualReaderGetAttrib(
+	IN EFI_SMART_CARD_READER_PROTOCOL *This,
+	IN UINT32 Attrib,
+	OUT UINT8 *OutBuffer,
+	IN OUT UINTN *OutBufferLength)
+{
+	static CONST char vendor[] = "Virtual";
+	VIRTUAL_READER *Reader;
+	CONST VOID *value;
+	UINTN length;
+	UINT32 max_input = MAX_INPUT;
+	UINT8 presence;
+
+	if ((NULL == This) || (NULL == OutBuffer) || (NULL == OutBufferLength))
+		return EFI_INVALID_PARAMETER;
+	Reader = VIRTUAL_READER_FROM_THIS(This);
+
+	switch (Attrib)
+	{
+		case SCARD_ATTR_ATR_STRING:
+			if (!Reader->Powered)
+				return EFI_NOT_READY;
+			value = atr;
+			length = atr_length;
+			break;
+
+		case SCARD_ATTR_ICC_PRESENCE:
+			/* card inserted */
+			presence = 2;
+			value = &presence;
+			length = sizeof presence;
+			break;
+
+		case SCARD_ATTR_MAXINPUT:
+			value = &max_input;
+			length = sizeof max_input;
+			break;
+
+		case SCARD_ATTR_VENDOR_NAME:
+			value = vendor;
+			length = sizeof vendor;
+			break;
+
+		default:
+			return EFI_UNSUPPORTED;
+	}
+
+	if (*OutBufferLength < length)
+	{
+		*OutBufferLength = length;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+
+	CopyMem(OutBuffer, value, length);
+	*OutBufferLength = length;
+
+	return EFI_SUCCESS;
+}
+
+static void FreeReaders(void)
+{
+	UINTN i;
+
+	for (i=0; i<nb_readers; i++)
+	{
+		if (readers[i].Handle)
+			gBS->UninstallMultipleProtocolInterfaces(readers[i].Handle,
+				&gEfiSmartCardReaderProtocolGuid, &readers[i].SmartCardReader,
+				NULL);
+		VirtualCardFree(&readers[i].Card);
+	}
+
+	FreePool(readers);
+	readers = NULL;
+	nb_readers = 0;
+}
+
+static EFI_STATUS EFIAPI VirtualReaderUnload(IN EFI_HANDLE ImageHandle)
+{
+	FreeReaders();
+
+	return EFI_SUCCESS;
+}
+
+/* skip the current word and the spaces after it */
+static CHAR16 *next_word(CHAR16 *p)
+{
+	while (*p && (*p != L' '))
+		p++;
+	while (*p == L' ')
+		p++;
+
+	return p;
+}
+
+static int hex_digit(CHAR16 c)
+{
+	if ((c >= L'0') && (c <= L'9'))
+		return c - L'0';
+	if ((c >= L'a') && (c <= L'f'))
+		return c - L'a' + 10;
+	if ((c >= L'A') && (c <= L'F'))
+		return c - L'A' + 10;
+
+	return -1;
+}
+
+/* parse "3BF81300..." */
+static UINTN parse_atr(CHAR16 *p, UINT8 *buffer, UINTN size)
+{
+	UINTN length = 0;
+
+	while ((length < size) && (hex_digit(p[0]) >= 0)
+		&& (hex_digit(p[1]) >= 0))
+	{
+		buffer[length++] = (hex_digit(p[0]) << 4) | hex_digit(p[1]);
+		p += 2;
+	}
+
+	return length;
+}
+
+/*
+ * Parse "VirtualReader.efi [number of readers] [options]" and return
+ * the number of readers
+ */
+static UINTN ParseLoadOptions(EFI_LOADED_IMAGE_PROTOCOL *LoadedImage)
+{
+	CHAR16 *p = LoadedImage->LoadOptions;
+	UINTN n = DEFAULT_READERS;
+
+	if ((NULL == p) || (0 == LoadedImage->LoadOptionsSize))
+		return n;
+
+	/* skip the image name */
+	for (p = next_word(p); *p; p = next_word(p))
+	{
+		if ((p[0] >= L'0') && (p[0] <= L'9'))
+		{
+			n = StrDecimalToUintn(p);
+			continue;
+		}
+
+		if ((p[0] != L'-') || (0 == p[1]))
+			continue;
+
+		switch (p[1])
+		{
+			case L't':
+				timed = TRUE;
+				break;
+
+			case L'f':
+				p = next_word(p);
+				card_clock = StrDecimalToUintn(p);
+				break;
+
+			case L'a':
+				p = next_word(p);
+				atr_length = parse_atr(p, atr, sizeof atr);
+				break;
+
+			case L'p':
+				p = next_word(p);
+				processing_ns = MultU64x32(StrDecimalToUintn(p), 1000);
+				break;
+		}
+	}
+
+	if (0 == n)
+		return DEFAULT_READERS;
+	if (n > MAX_READERS)
+		return MAX_READERS;
+
+	return n;
+}
+
+EFI_STATUS EFIAPI VirtualReaderEntryPoint(
+	IN EFI_HANDLE ImageHandle,
+	IN EFI_SYSTEM_TABLE *SystemTable)
+{
+	EFI_STATUS Status;
+	EFI_LOADED_IMAGE_PROTOCOL *LoadedImage;
+	UINTN i, n;
+
+	Status = gBS->HandleProtocol(ImageHandle, &gEfiLoadedImageProtocolGuid,
+		(VOID **)&LoadedImage);
+	if (EFI_ERROR(Status))
+		return Status;
+
+	n = ParseLoadOptions(LoadedImage);
+
+	if (0 == atr_length)
+	{
+		CopyMem(atr, VirtualCardAtr, VirtualCardAtrLength);
+		atr_length = VirtualCardAtrLength;
+	}
+
+	readers = AllocateZeroPool(n * sizeof *readers);
+	if (NULL == readers)
+		return EFI_OUT_OF_RESOURCES;
+
+	for (i=0; i<n; i++)
+	{
+		VIRTUAL_READER *Reader = &readers[i];
+
+		Reader->Signature = VIRTUAL_READER_SIGNATURE;
+		Reader->SmartCardReader.SCardConnect = VirtualReaderConnect;
+		Reader->SmartCardReader.SCardDisconnect = VirtualReaderDisconnect;
+		Reader->SmartCardReader.SCardStatus = VirtualReaderStatus;
+		Reader->SmartCardReader.SCardTransmit = VirtualReaderTransmit;
+		Reader->SmartCardReader.SCardControl = VirtualReaderControl;
+		Reader->SmartCardReader.SCardGetAttrib = VirtualReaderGetAttrib;
+		UnicodeSPrint(Reader->ReaderName, sizeof Reader->ReaderName,
+			L"Virtual Reader %d", i);
+		TimingFromAtr(&Reader->Timing, atr, atr_length, card_clock);
+
+		Status = VirtualCardInit(&Reader->Card);
+		if (EFI_ERROR(Status))
+			break;
+		nb_readers++;
+
+		Status = gBS->InstallMultipleProtocolInterfaces(&Reader->Handle,
+			&gEfiSmartCardReaderProtocolGuid, &Reader->SmartCardReader,
+			NULL);
+		if (EFI_ERROR(Status))
+		{
+			Reader->Handle = NULL;
+			break;
+		}
+	}
+
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: VirtualReader: %r\n", Status);
+		FreeReaders();
+		return Status;
+	}
+
+	LoadedImage->Unload = VirtualReaderUnload;
+	Print(L"%d virtual reader(s) installed\n", nb_readers);
+	if (timed)
+	{
+		TIMING *t = &readers[0].Timing;
+
+		Print(L"timing: f=%d Hz, Fi=%d, Di=%d, N=%d, etu=%ld ns, "
+			L"WI=%d, BWI=%d, CWI=%d, IFSC=%d\n",
+			t->f, t->Fi, t->Di, t->N, DivU64x32(TimingEtu(t), 1000),
+			t->WI, t->BWI, t->CWI, t->IFSC);
+	}
+
+	return EFI_SUCCESS;
+}
@@ -0,0 +1,556 @@
+/*
+    apdu_script.c: run a script of APDUs against a smart card reader
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 51
+	Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Usage: apdu_script <script file> [r<n>] [v]
+ *
+ * The script is read one line at a time. Blank lines and lines
+ * starting with '#' are ignored. The commands are:
+ *
+ * echo <text>              print the text
+ * reset                    cold reset the card
+ * send <bytes>             send an APDU
+ * expect <bytes> [mask <bytes>]
+ *                          check the response of the last APDU sent.
+ *                          Only the bits set in the mask are compared.
+ *                          The mask defaults to FF for every byte.
+ * repeat <n>               repeat the block up to the matching "end"
+ *                          n times
+ * loop <start> <end>       repeat the block up to the matching "end"
+ *                          with L going from start to end
+ * end                      end of a repeat or loop block
+ *
+ * <bytes> is a list of hex bytes ("00 A4 04 00" or "00A40400") and
+ * of variables using L, the value of the innermost loop:
+ * $L       L on 1 byte
+ * $W       L on 2 bytes (big endian)
+ * $I       L bytes: 00 01 02 ...
+ * $Rxx     L bytes of value xx
+ *
+ * Example, short APDU Case 3 with the test applet:
+ * send 00 A4 04 00 06 A0 00 00 00 18 FF
+ * expect 90 00
+ * loop 1 255
+ *   send 80 32 00 00 $L $I
+ *   expect 90 00
+ * end
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/ShellCEntryLib.h>
+#include <Library/ShellLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Protocol/SmartCardReader.h>
+
+#define MAX_BUFFER_SIZE_EXTENDED    (4 + 3 + (1<<16) + 3 + 2)   /**< enhanced (64K + APDU + Lc + Le + SW) Tx/Rx Buffer */
+
+#define MAX_LINE_LENGTH 1024
+#define MAX_NESTING 8
+
+typedef struct
+{
+	UINT64 position;	/**< file position just after the repeat/loop line */
+	unsigned int line;	/**< line number of the repeat/loop line */
+	int is_loop;		/**< loop (with L) or repeat (without L) */
+	unsigned int value;	/**< current value of L or repeat counter */
+	unsigned int last;	/**< last value of L or number of repeats */
+} BLOCK;
+
+/* buffers are allocated once and reused for every APDU */
+static UINT8 s[MAX_BUFFER_SIZE_EXTENDED];
+static UINT8 r[MAX_BUFFER_SIZE_EXTENDED];
+static UINT8 e[MAX_BUFFER_SIZE_EXTENDED];
+static UINT8 m[MAX_BUFFER_SIZE_EXTENDED];
+static CHAR16 line[MAX_LINE_LENGTH];
+
+static int verbose = 0;
+
+static CHAR16 *skip_blanks(CHAR16 *p)
+{
+	while ((' ' == *p) || ('\t' == *p))
+		p++;
+
+	return p;
+}
+
+/* return 1 and skip the keyword if p starts with it */
+static int is_keyword(CHAR16 **p, CONST CHAR16 *keyword)
+{
+	UINTN len = StrLen(keyword);
+	CHAR16 next;
+
+	if (StrnCmp(*p, keyword, len))
+		return 0;
+
+	next = (*p)[len];
+	if (next && (next != ' ') && (next != '\t'))
+		return 0;
+
+	*p = skip_blanks(*p + len);
+	return 1;
+}
+
+static int hex_value(CHAR16 c)
+{
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+static unsigned int parse_number(CHAR16 **p)
+{
+	unsigned int value;
+
+	value = StrDecimalToUintn(*p);
+	while ((**p >= '0') && (**p <= '9'))
+		(*p)++;
+	*p = skip_blanks(*p);
+
+	return value;
+}
+
+/* parse hex bytes and variables until the end of line or a keyword */
+static int parse_bytes(CHAR16 **pp, unsigned int L, UINT8 buffer[],
+	UINTN *length)
+{
+	CHAR16 *p = *pp;
+	UINTN n = 0;
+	unsigned int i;
+
+	for (p = skip_blanks(p); *p; p = skip_blanks(p))
+	{
+		int high, low;
+		unsigned int count = 1;
+
+		if ('$' == *p)
+		{
+			switch (p[1])
+			{
+				case 'L':
+				case 'W':
+				case 'I':
+					count = ('L' == p[1]) ? 1 : ('W' == p[1]) ? 2 : L;
+					break;
+				case 'R':
+					count = L;
+					if ((hex_value(p[2]) < 0) || (hex_value(p[3]) < 0))
+					{
+						Print(L"ERROR: $R needs a hex byte\n");
+						return 1;
+					}
+					break;
+				default:
+					Print(L"ERROR: unknown variable $%c\n", p[1]);
+					return 1;
+			}
+
+			if (n + count > MAX_BUFFER_SIZE_EXTENDED)
+				goto too_long;
+
+			switch (p[1])
+			{
+				case 'L':
+					buffer[n++] = L;
+					break;
+				case 'W':
+					buffer[n++] = L >> 8;
+					buffer[n++] = L;
+					break;
+				case 'I':
+					for (i=0; i<L; i++)
+						buffer[n++] = i;
+					break;
+				case 'R':
+					SetMem(buffer + n, L,
+						(hex_value(p[2]) << 4) + hex_value(p[3]));
+					n += L;
+					p += 2;
+					break;
+			}
+			p += 2;
+			continue;
+		}
+
+		high = hex_value(p[0]);
+		if (high < 0)
+			/* not a byte: keyword */
+			break;
+
+		low = hex_value(p[1]);
+		if (low < 0)
+		{
+			Print(L"ERROR: odd number of hex digits\n");
+			return 1;
+		}
+
+		if (n + 1 > MAX_BUFFER_SIZE_EXTENDED)
+			goto too_long;
+
+		buffer[n++] = (high << 4) + low;
+		p += 2;
+	}
+
+	*pp = p;
+	*length = n;
+	return 0;
+
+too_long:
+	Print(L"ERROR: more than %d bytes\n", MAX_BUFFER_SIZE_EXTENDED);
+	return 1;
+} /* parse_bytes */
+
+static void dump(CONST CHAR16 *text, UINT8 buffer[], UINTN length)
+{
+	UINTN i;
+
+	Print(L"%s (%d): ", text, length);
+	for (i=0; i<length; i++)
+		Print(L"%02X ", buffer[i]);
+	Print(L"\n");
+}
+
+static EFI_STATUS connect(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
+{
+	EFI_STATUS Status;
+	UINT32 ActiveProtocol;
+
+	Status = SmartCardReader->SCardConnect(SmartCardReader,
+		SCARD_AM_CARD,
+		SCARD_CA_COLDRESET,
+		SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
+		&ActiveProtocol);
+	if (EFI_ERROR(Status))
+		Print(L"ERROR: SCardConnect: %d\n", Status);
+
+	return Status;
+}
+
+static int RunScript(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	SHELL_FILE_HANDLE File)
+{
+	EFI_STATUS Status;
+	BLOCK blocks[MAX_NESTING];
+	int depth = 0;
+	int skip = 0;		/* nesting level of a block executed 0 times */
+	unsigned int line_number = 0;
+	unsigned int L = 0;
+	BOOLEAN Ascii = FALSE;
+	UINTN Size;
+	UINTN s_length, r_length = 0, e_length, m_length;
+	unsigned int nb_apdu = 0, nb_check = 0;
+	UINTN i;
+	int ret = 1;
+
+	Status = ShellSetFilePosition(File, 0);
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: ShellSetFilePosition: %d\n", Status);
+		return 1;
+	}
+
+	if (EFI_ERROR(connect(SmartCardReader)))
+		return 1;
+
+	while (!ShellFileHandleEof(File))
+	{
+		CHAR16 *p;
+		int is_loop;
+
+		Size = sizeof line;
+		Status = ShellFileHandleReadLine(File, line, &Size, FALSE, &Ascii);
+		if (EFI_BUFFER_TOO_SMALL == Status)
+		{
+			Print(L"ERROR: line %d: longer than %d characters\n",
+				line_number + 1, MAX_LINE_LENGTH - 1);
+			goto end;
+		}
+		if (EFI_ERROR(Status))
+		{
+			Print(L"ERROR: ShellFileHandleReadLine: %d\n", Status);
+			goto end;
+		}
+		line_number++;
+
+		p = skip_blanks(line);
+		if ((0 == *p) || ('#' == *p))
+			continue;
+
+		if (skip)
+		{
+			/* only track the nesting of a block executed 0 times */
+			if (is_keyword(&p, L"repeat") || is_keyword(&p, L"loop"))
+				skip++;
+			else
+				if (is_keyword(&p, L"end"))
+					skip--;
+			continue;
+		}
+
+		if (is_keyword(&p, L"echo"))
+			Print(L"%s\n", p);
+		else if (is_keyword(&p, L"reset"))
+		{
+			SmartCardReader->SCardDisconnect(SmartCardReader,
+				SCARD_CA_NORESET);
+			if (EFI_ERROR(connect(SmartCardReader)))
+				goto error;
+		}
+		else if (is_keyword(&p, L"send"))
+		{
+			if (parse_bytes(&p, L, s, &s_length) || *p)
+				goto syntax;
+
+			if (verbose)
+				dump(L"Sent", s, s_length);
+
+			r_length = sizeof r;
+			Status = SmartCardReader->SCardTransmit(SmartCardReader,
+				s, s_length, r, &r_length);
+			nb_apdu++;
+			if (EFI_ERROR(Status))
+			{
+				Print(L"ERROR: SCardTransmit: %d\n", Status);
+				goto error;
+			}
+
+			if (verbose)
+				dump(L"Received", r, r_length);
+		}
+		else if (is_keyword(&p, L"expect"))
+		{
+			if (parse_bytes(&p, L, e, &e_length))
+				goto syntax;
+
+			m_length = 0;
+			if (is_keyword(&p, L"mask"))
+				if (parse_bytes(&p, L, m, &m_length))
+					goto syntax;
+			if (*p)
+				goto syntax;
+
+			if (r_length != e_length)
+			{
+				Print(L"ERROR: Expected %d bytes and received %d\n",
+					e_length, r_length);
+				goto error;
+			}
+
+			for (i=0; i<e_length; i++)
+			{
+				UINT8 mask = (i < m_length) ? m[i] : 0xFF;
+
+				if ((r[i] & mask) != (e[i] & mask))
+				{
+					Print(L"ERROR byte %d: expected 0x%02X, got 0x%02X (mask 0x%02X)\n",
+						i, e[i], r[i], mask);
+					goto error;
+				}
+			}
+			nb_check++;
+		}
+		else if ((is_loop = is_keyword(&p, L"loop"))
+			|| is_keyword(&p, L"repeat"))
+		{
+			BLOCK *block;
+
+			if (depth >= MAX_NESTING)
+			{
+				Print(L"ERROR: line %d: more than %d nested blocks\n",
+					line_number, MAX_NESTING);
+				goto end;
+			}
+
+			block = &blocks[depth];
+			block->is_loop = is_loop;
+			block->line = line_number;
+			if (is_loop)
+			{
+				block->value = parse_number(&p);
+				block->last = parse_number(&p);
+			}
+			else
+			{
+				block->value = 1;
+				block->last = parse_number(&p);
+			}
+			if (*p)
+				goto syntax;
+
+			if (block->value > block->last)
+			{
+				skip = 1;
+				continue;
+			}
+
+			ShellGetFilePosition(File, &block->position);
+			if (is_loop)
+				L = block->value;
+			depth++;
+		}
+		else if (is_keyword(&p, L"end"))
+		{
+			BLOCK *block;
+
+			if (*p || (0 == depth))
+				goto syntax;
+
+			block = &blocks[depth-1];
+			if (block->value < block->last)
+			{
+				/* next iteration: go back to the start of the block */
+				block->value++;
+				if (block->is_loop)
+					L = block->value;
+				ShellSetFilePosition(File, block->position);
+				line_number = block->line;
+			}
+			else
+			{
+				/* restore L of the enclosing loop */
+				depth--;
+				for (i=depth; i>0; i--)
+					if (blocks[i-1].is_loop)
+					{
+						L = blocks[i-1].value;
+						break;
+					}
+			}
+		}
+		else
+			goto syntax;
+	}
+
+	if (depth || skip)
+	{
+		Print(L"ERROR: missing \"end\"\n");
+		goto end;
+	}
+
+	Print(L"%d APDU(s) sent, %d response(s) checked: OK\n", nb_apdu, nb_check);
+	ret = 0;
+	goto end;
+
+syntax:
+	Print(L"ERROR: line %d: syntax error\n", line_number);
+	goto end;
+
+error:
+	Print(L"ERROR: line %d: %s\n", line_number, line);
+	if (depth)
+		Print(L"L = %d\n", L);
+
+end:
+	SmartCardReader->SCardDisconnect(SmartCardReader, SCARD_CA_NORESET);
+
+	return ret;
+} /* RunScript */
+
+INTN
+EFIAPI
+ShellAppMain (
+  IN UINTN Argc,
+  IN CHAR16 **Argv
+  )
+{
+	EFI_STATUS  Status;
+	UINTN       HandleIndex, HandleCount;
+	EFI_HANDLE  *DevicePathHandleBuffer = NULL;
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader;
+	SHELL_FILE_HANDLE File;
+	int i;
+	int reader = -1;
+	int ret = 0;
+
+	if (Argc < 2)
+	{
+		Print(L"Usage: %s script [r<reader>] [v]\n", Argv[0]);
+		return 1;
+	}
+
+	for (i=2; i<Argc; i++)
+	{
+		switch(Argv[i][0])
+		{
+			case 'r':
+				reader = StrDecimalToUintn(Argv[i]+1);
+				Print(L"Using reader: %d\n", reader);
+				break;
+
+			case 'v':
+				verbose = 1;
+				break;
+		}
+	}
+
+	Status = ShellOpenFileByName(Argv[1], &File, EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: Can't open %s: %d\n", Argv[1], Status);
+		return 1;
+	}
+
+	/* EFI_SMART_CARD_READER_PROTOCOL */
+	Status = gBS->LocateHandleBuffer(
+			ByProtocol,
+			&gEfiSmartCardReaderProtocolGuid,
+			NULL,
+			&HandleCount,
+			&DevicePathHandleBuffer);
+
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: Get EFI_SMART_CARD_READER_PROTOCOL count fail.\n");
+		ShellCloseFile(&File);
+		return 1;
+	}
+
+	Print(L"Found %d reader(s)\n", HandleCount);
+	for (HandleIndex = 0; HandleIndex < HandleCount; HandleIndex++)
+	{
+		ZeroMem(&SmartCardReader, sizeof SmartCardReader);
+
+		Status = gBS->HandleProtocol(
+				DevicePathHandleBuffer[HandleIndex],
+				&gEfiSmartCardReaderProtocolGuid,
+				(VOID**)&SmartCardReader);
+
+		if (EFI_ERROR(Status))
+		{
+			Print(L"ERROR: Open Protocol fail.\n");
+			ret = 1;
+			break;
+		}
+
+		Print(L"reader %d\n", HandleIndex);
+		if (reader < 0 || reader == HandleIndex)
+			if (RunScript(SmartCardReader, File))
+				ret = 1;
+	}
+	gBS->FreePool(DevicePathHandleBuffer);
+	ShellCloseFile(&File);
+
+	return ret;
+}
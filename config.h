@@ -44,20 +44,70 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <Library/BaseMemoryLib.h>
 #include <Library/MemoryAllocationLib.h>
 
-#define free(a) FreePool(a)
-#define getenv(a) NULL
-#define malloc(a) AllocateZeroPool(a)
+/*
+ * libc compatibility, see Library/CompatLib. Not for an AP: the sleeps
+ * and malloc use boot services.
+ */
+extern int compat_errno;
+void *compat_malloc(UINTN size);
+void *compat_calloc(UINTN nmemb, UINTN size);
+void compat_free(void *ptr);
+int compat_usleep(UINTN usec);
+unsigned int compat_sleep(unsigned int seconds);
+int compat_strncmp(const char *s1, const char *s2, UINTN n);
+char *compat_getenv(const char *name);
+const char *compat_strerror(int errnum);
+
+/*
+ * malloc() keeps the freed APDU sized buffers (short and extended) in a
+ * pool to reuse them without calling the boot services
+ */
+#define POOL_CLASSES 2
+
+typedef struct
+{
+	UINTN size;			/**< size of the buffers of the class */
+	UINT64 hits;		/**< allocations served from the pool */
+	UINT64 misses;		/**< allocations from AllocatePool() */
+	UINTN in_use;		/**< buffers allocated and not freed */
+	UINTN peak;			/**< highest in_use */
+	UINTN cached;		/**< free buffers kept in the pool */
+} POOL_CLASS_STATS;
+
+typedef struct
+{
+	POOL_CLASS_STATS classes[POOL_CLASSES];
+	UINT64 unpooled;	/**< allocations of another size */
+	UINT64 errors;		/**< bad free() or buffer written after free() */
+} POOL_STATS;
+
+/* fill the buffers with 0xA5 on malloc() and 0xDD on free() */
+void PoolPoison(BOOLEAN Enable);
+void PoolGetStats(POOL_STATS *Stats);
+void PoolPrintStats(void);
+/* give the cached buffers back to the boot services */
+void PoolFlush(void);
+
+#define free(a) compat_free(a)
+#define getenv(a) compat_getenv(a)
+#define malloc(a) compat_malloc(a)
+#define calloc(n, a) compat_calloc(n, a)
 #define memcpy CopyMem
 #define memmove CopyMem
 #define memset(buffer, value, length) SetMem(buffer, length, value)
-#define sleep(a) a
-#define strncmp(s1, s2, n) -1
-#define strerror(a) ""
+#define sleep(a) compat_sleep(a)
+#define strncmp(s1, s2, n) compat_strncmp(s1, s2, n)
+#define strerror(a) compat_strerror(a)
 #define memcmp CompareMem
+#define usleep(a) compat_usleep(a)
 
-/* TODO */
-#define usleep(a) 1
-#define ENODEV -1
-#define errno -1
-#define htonl(a) (a)
+#define EPERM 1
+#define EINTR 4
+#define EIO 5
+#define ENOMEM 12
+#define ENODEV 19
+#define EINVAL 22
+#define ETIMEDOUT 110
+#define errno compat_errno
 
+#define htonl(a) (a)
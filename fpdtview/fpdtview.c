@@ -0,0 +1,338 @@
+/*
+    fpdtview.c: print the PERF records of the firmware performance table
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 51
+	Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Usage: fpdtview [g] [text]
+ *
+ * Find the ACPI FPDT table, follow its pointer to the firmware basic
+ * boot performance table (FBPT) and print a timeline of the phases
+ * recorded with PERF_INMODULE_BEGIN/END or PERF_CROSSMODULE_BEGIN/END,
+ * like the ones of valid_SmartCardReader and scardcontrol.
+ * g      also print the GUID of the module of each phase
+ * text   only print the phases containing text, like "Reader0"
+ *
+ * The records of the applications run from the shell are only kept if
+ * the firmware reserved room for them in the FBPT
+ * (PcdExtFpdtBootRecordPadSize).
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/ShellCEntryLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PerformanceLib.h>
+#include <IndustryStandard/Acpi.h>
+#include <Guid/Acpi.h>
+#include <Guid/ExtendedFirmwarePerformance.h>
+
+/* width of the timeline bar */
+#define BAR_WIDTH 32
+
+typedef struct
+{
+	UINT64 start;		/**< ns */
+	UINT64 end;			/**< ns, 0 if not ended */
+	EFI_GUID *Guid;		/**< module */
+	CHAR8 *String;
+	UINTN Length;
+} PHASE;
+
+static EFI_ACPI_DESCRIPTION_HEADER *FindFpdt(void)
+{
+	EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER *Rsdp = NULL;
+	EFI_ACPI_DESCRIPTION_HEADER *Table;
+	UINTN i, nb, entry_size;
+	UINT8 *entries;
+
+	if (EFI_ERROR(EfiGetSystemConfigurationTable(&gEfiAcpi20TableGuid,
+		(VOID **)&Rsdp))
+		&& EFI_ERROR(EfiGetSystemConfigurationTable(&gEfiAcpi10TableGuid,
+		(VOID **)&Rsdp)))
+		return NULL;
+
+	/* XSDT if available, else RSDT */
+	if ((Rsdp->Revision >= 2) && Rsdp->XsdtAddress)
+	{
+		Table = (EFI_ACPI_DESCRIPTION_HEADER *)(UINTN)Rsdp->XsdtAddress;
+		entry_size = sizeof(UINT64);
+	}
+	else
+	{
+		Table = (EFI_ACPI_DESCRIPTION_HEADER *)(UINTN)Rsdp->RsdtAddress;
+		entry_size = sizeof(UINT32);
+	}
+
+	entries = (UINT8 *)(Table + 1);
+	nb = (Table->Length - sizeof *Table) / entry_size;
+	for (i=0; i<nb; i++)
+	{
+		EFI_ACPI_DESCRIPTION_HEADER *Entry;
+
+		if (sizeof(UINT64) == entry_size)
+			Entry = (EFI_ACPI_DESCRIPTION_HEADER *)(UINTN)
+				ReadUnaligned64((UINT64 *)(entries + i * entry_size));
+		else
+			Entry = (EFI_ACPI_DESCRIPTION_HEADER *)(UINTN)
+				ReadUnaligned32((UINT32 *)(entries + i * entry_size));
+
+		if (Entry && (EFI_ACPI_5_0_FIRMWARE_PERFORMANCE_DATA_TABLE_SIGNATURE
+			== Entry->Signature))
+			return Entry;
+	}
+
+	return NULL;
+}
+
+static EFI_ACPI_5_0_FPDT_BOOT_PERFORMANCE_TABLE_HEADER *FindFbpt(
+	EFI_ACPI_DESCRIPTION_HEADER *Fpdt)
+{
+	UINT8 *p = (UINT8 *)(Fpdt + 1);
+	UINT8 *end = (UINT8 *)Fpdt + Fpdt->Length;
+
+	while (p + sizeof(EFI_ACPI_5_0_FPDT_PERFORMANCE_RECORD_HEADER) <= end)
+	{
+		EFI_ACPI_5_0_FPDT_PERFORMANCE_RECORD_HEADER *Header = (VOID *)p;
+
+		if (0 == Header->Length)
+			break;
+
+		if (EFI_ACPI_5_0_FPDT_RECORD_TYPE_FIRMWARE_BASIC_BOOT_POINTER
+			== Header->Type)
+		{
+			EFI_ACPI_5_0_FPDT_BOOT_PERFORMANCE_TABLE_POINTER_RECORD *Pointer
+				= (VOID *)p;
+			EFI_ACPI_5_0_FPDT_BOOT_PERFORMANCE_TABLE_HEADER *Fbpt
+				= (VOID *)(UINTN)Pointer->BootPerformanceTablePointer;
+
+			if (Fbpt && (EFI_ACPI_5_0_FPDT_BOOT_PERFORMANCE_TABLE_SIGNATURE
+				== Fbpt->Signature))
+				return Fbpt;
+		}
+
+		p += Header->Length;
+	}
+
+	return NULL;
+}
+
+static BOOLEAN same_phase(PHASE *phase, FPDT_DYNAMIC_STRING_EVENT_RECORD *r,
+	CHAR8 *String, UINTN Length)
+{
+	return (phase->Length == Length)
+		&& CompareGuid(phase->Guid, &r->Guid)
+		&& (0 == CompareMem(phase->String, String, Length));
+}
+
+/* match the BEGIN and END records; return the number of phases */
+static UINTN ReadPhases(EFI_ACPI_5_0_FPDT_BOOT_PERFORMANCE_TABLE_HEADER *Fbpt,
+	PHASE *phases, UINTN max_phases)
+{
+	UINT8 *p = (UINT8 *)(Fbpt + 1);
+	UINT8 *end = (UINT8 *)Fbpt + Fbpt->Length;
+	UINTN nb = 0;
+
+	while (p + sizeof(EFI_ACPI_5_0_FPDT_PERFORMANCE_RECORD_HEADER) <= end)
+	{
+		EFI_ACPI_5_0_FPDT_PERFORMANCE_RECORD_HEADER *Header = (VOID *)p;
+		FPDT_DYNAMIC_STRING_EVENT_RECORD *r = (VOID *)p;
+		CHAR8 *String;
+		UINTN Length, i;
+
+		if (0 == Header->Length)
+			break;
+		p += Header->Length;
+
+		if ((FPDT_DYNAMIC_STRING_EVENT_TYPE != Header->Type)
+			|| (Header->Length <= sizeof *r))
+			continue;
+
+		/* the string is NUL terminated inside the record */
+		String = (CHAR8 *)(r + 1);
+		for (Length = 0; (Length < Header->Length - sizeof *r)
+			&& String[Length]; Length++)
+			;
+
+		switch (r->ProgressID)
+		{
+			case PERF_INMODULE_START_ID:
+			case PERF_CROSSMODULE_START_ID:
+				if (nb >= max_phases)
+					break;
+				phases[nb].start = r->Timestamp;
+				phases[nb].end = 0;
+				phases[nb].Guid = &r->Guid;
+				phases[nb].String = String;
+				phases[nb].Length = Length;
+				nb++;
+				break;
+
+			case PERF_INMODULE_END_ID:
+			case PERF_CROSSMODULE_END_ID:
+				/* the last phase of the same name not ended yet */
+				for (i=nb; i>0; i--)
+					if ((0 == phases[i-1].end)
+						&& same_phase(&phases[i-1], r, String, Length))
+					{
+						phases[i-1].end = r->Timestamp;
+						break;
+					}
+				break;
+		}
+	}
+
+	return nb;
+}
+
+/* print the phase name, a CHAR8 string not NUL terminated */
+static void PrintName(PHASE *phase)
+{
+	CHAR16 Name[41];
+	UINTN i;
+
+	for (i=0; (i < phase->Length) && (i < ARRAY_SIZE(Name) - 1); i++)
+		Name[i] = phase->String[i];
+	Name[i] = L'\0';
+
+	Print(L"%-40s", Name);
+}
+
+static BOOLEAN match(PHASE *phase, CHAR8 *filter)
+{
+	UINTN length, i;
+
+	if (NULL == filter)
+		return TRUE;
+
+	length = AsciiStrLen(filter);
+	for (i=0; i + length <= phase->Length; i++)
+		if (0 == CompareMem(phase->String + i, filter, length))
+			return TRUE;
+
+	return FALSE;
+}
+
+INTN
+EFIAPI
+ShellAppMain (
+  IN UINTN Argc,
+  IN CHAR16 **Argv
+  )
+{
+	EFI_ACPI_DESCRIPTION_HEADER *Fpdt;
+	EFI_ACPI_5_0_FPDT_BOOT_PERFORMANCE_TABLE_HEADER *Fbpt;
+	PHASE *phases;
+	UINTN nb, max_phases, i, j;
+	UINT64 first = MAX_UINT64, last = 0, span;
+	BOOLEAN guid = FALSE;
+	CHAR8 filter_buffer[40];
+	CHAR8 *filter = NULL;
+
+	for (i=1; i<Argc; i++)
+	{
+		if (0 == StrCmp(Argv[i], L"g"))
+			guid = TRUE;
+		else
+		{
+			UnicodeStrToAsciiStrS(Argv[i], filter_buffer,
+				sizeof filter_buffer);
+			filter = filter_buffer;
+		}
+	}
+
+	Fpdt = FindFpdt();
+	if (NULL == Fpdt)
+	{
+		Print(L"ERROR: no ACPI FPDT table\n");
+		return 1;
+	}
+
+	Fbpt = FindFbpt(Fpdt);
+	if (NULL == Fbpt)
+	{
+		Print(L"ERROR: no firmware basic boot performance table\n");
+		return 1;
+	}
+
+	/* a phase needs at least one record of a header and a GUID */
+	max_phases = Fbpt->Length / sizeof(FPDT_DYNAMIC_STRING_EVENT_RECORD);
+	phases = AllocatePool(max_phases * sizeof *phases);
+	if (NULL == phases)
+	{
+		Print(L"ERROR: not enough memory\n");
+		return 1;
+	}
+
+	nb = ReadPhases(Fbpt, phases, max_phases);
+
+	/* time span of the phases to print */
+	for (i=0; i<nb; i++)
+	{
+		if (!match(&phases[i], filter))
+			continue;
+		if (phases[i].start < first)
+			first = phases[i].start;
+		if (phases[i].end > last)
+			last = phases[i].end;
+		if (phases[i].start > last)
+			last = phases[i].start;
+	}
+	span = (last > first) ? last - first : 1;
+
+	Print(L"%-40s %10s %10s\n", L"Phase", L"Start(us)", L"Time(us)");
+	for (i=0; i<nb; i++)
+	{
+		PHASE *phase = &phases[i];
+		UINTN from, to;
+		CHAR16 Bar[BAR_WIDTH + 1];
+
+		if (!match(phase, filter))
+			continue;
+
+		PrintName(phase);
+		Print(L" %10ld", DivU64x32(phase->start - first, 1000));
+		if (phase->end)
+			Print(L" %10ld", DivU64x32(phase->end - phase->start, 1000));
+		else
+			Print(L" %10s", L"-");
+
+		/* position of the phase in the time span */
+		from = (UINTN)DivU64x64Remainder(
+			MultU64x32(phase->start - first, BAR_WIDTH), span, NULL);
+		to = phase->end ? (UINTN)DivU64x64Remainder(
+			MultU64x32(phase->end - first, BAR_WIDTH), span, NULL) : from;
+		if (to >= BAR_WIDTH)
+			to = BAR_WIDTH - 1;
+		if (from > to)
+			from = to;
+		for (j=0; j<BAR_WIDTH; j++)
+			Bar[j] = ((j >= from) && (j <= to)) ? L'#' : L'.';
+		Bar[BAR_WIDTH] = L'\0';
+		Print(L" %s", Bar);
+
+		if (guid)
+			Print(L" %g", phase->Guid);
+		Print(L"\n");
+	}
+
+	FreePool(phases);
+
+	return 0;
+}
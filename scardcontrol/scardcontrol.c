@@ -25,13 +25,19 @@
 #include <Library/UefiLib.h>
 #include <Library/ShellCEntryLib.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
 #include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
+#include <Library/PerformanceLib.h>
 #include <Protocol/SmartCardReader.h>
 
 #include "../config.h"
 
 #include "../reader.h"
 
+#include "../transmit.h"
+#include "../stopwatch.h"
+
 #include "PCSCv2part10.h"
 
 #define VERIFY_PIN
@@ -63,6 +69,82 @@ if (rv != EFI_SUCCESS) \
 else \
 	Print(text ": OK\n\n");
 
+/*
+ * Capability cache: the answers of the discovery of a reader model are
+ * stored in the non volatile variable "ReaderCapsVVVVPPPPCCCCCCCC" where
+ * VVVV is wIdVendor, PPPP wIdProduct and CCCCCCCC the CRC32 of
+ * sFirmwareID. Only the bytes of the answers are stored so a variable
+ * stays well below the usual PcdMaxVariableSize (1 KiB).
+ * The variable "ReaderCapabilities" lists the GET_TLV_PROPERTIES ioctl
+ * codes of the models, to find the key of a reader before its entry.
+ * An entry is used only if the reader gives the same GET_TLV_PROPERTIES
+ * answer.
+ */
+static EFI_GUID CapabilityGuid =
+	{ 0x4214be81, 0x6ce0, 0x4651, { 0xa0, 0xc1, 0x19, 0x73, 0x95, 0xf6, 0xe8, 0x32 } };
+
+#define CAPABILITY_INDEX L"ReaderCapabilities"
+#define CAPABILITY_VERSION 2
+#define CAPABILITY_IOCTLS 8
+
+/* answers of the reader discovery */
+typedef struct
+{
+	UINT16 wIdVendor;
+	UINT16 wIdProduct;
+	UINT8 FirmwareID[32];
+	UINT32 FirmwareIDLength;
+	UINT32 properties_ioctl;	/**< GET_TLV_PROPERTIES, 0 if none */
+	UINT32 features_length;
+	UINT8 features[MAX_BUFFER_SIZE];	/**< CM_IOCTL_GET_FEATURE_REQUEST */
+	UINT32 properties_length;
+	UINT8 properties[MAX_BUFFER_SIZE];	/**< GET_TLV_PROPERTIES */
+	UINT32 mct_length;
+	UINT8 mct[64];				/**< MCT_READER_DIRECT secoder info */
+	UINT32 pin_properties_length;
+	UINT8 pin_properties[16];	/**< FEATURE_IFD_PIN_PROPERTIES */
+} READER_CAPABILITIES;
+
+/* content of "ReaderCapabilities" */
+typedef struct
+{
+	UINT32 version;
+	UINT32 count;
+	UINT32 ioctls[CAPABILITY_IOCTLS];	/**< GET_TLV_PROPERTIES codes */
+} CAPABILITY_INDEX_VARIABLE;
+
+/*
+ * Header of a "ReaderCaps" variable, followed by the FirmwareID,
+ * features, properties, mct and pin_properties bytes.
+ */
+typedef struct
+{
+	UINT32 version;
+	UINT32 properties_ioctl;
+	UINT32 lengths[5];
+} CAPABILITY_RECORD;
+
+/* largest record */
+#define CAPABILITY_RECORD_MAX (sizeof(CAPABILITY_RECORD) \
+	+ 32 + 2*MAX_BUFFER_SIZE + 64 + 16)
+
+/* do not use the cache, 'f' option */
+static BOOLEAN full_discovery;
+
+/* PERF marker of the running phase, see fpdtview */
+static const char *current_phase;
+
+/* end the running phase and start the next one, NULL to only end it */
+static void phase(const char *name)
+{
+	if (current_phase)
+		PERF_INMODULE_END(current_phase);
+
+	current_phase = name;
+	if (name)
+		PERF_INMODULE_BEGIN(name);
+}
+
 static void parse_properties(unsigned char *bRecvBuffer, int length)
 {
 	unsigned char *p;
@@ -177,21 +259,362 @@ static const char *pinpad_return_codes(unsigned char bRecvBuffer[])
 	return ret;
 }
 
+/* get the cache key from the GET_TLV_PROPERTIES answer */
+static void capability_key(READER_CAPABILITIES *caps)
+{
+	unsigned char *p = caps->properties;
+	int value;
+
+	caps->wIdVendor = caps->wIdProduct = 0;
+	caps->FirmwareIDLength = 0;
+
+	if (0 == PCSCv2Part10_find_TLV_property_by_tag_from_buffer(caps->properties,
+		caps->properties_length, PCSCv2_PART10_PROPERTY_wIdVendor, &value))
+		caps->wIdVendor = value;
+	if (0 == PCSCv2Part10_find_TLV_property_by_tag_from_buffer(caps->properties,
+		caps->properties_length, PCSCv2_PART10_PROPERTY_wIdProduct, &value))
+		caps->wIdProduct = value;
+
+	/* sFirmwareID is a string, not an integer */
+	while (p + 2 <= caps->properties + caps->properties_length)
+	{
+		int tag = *p++;
+		int len = *p++;
+
+		if (p + len > caps->properties + caps->properties_length)
+			break;
+
+		if (PCSCv2_PART10_PROPERTY_sFirmwareID == tag)
+		{
+			if (len > sizeof caps->FirmwareID)
+				len = sizeof caps->FirmwareID;
+			memcpy(caps->FirmwareID, p, len);
+			caps->FirmwareIDLength = len;
+			break;
+		}
+		p += len;
+	}
+}
+
+static BOOLEAN same_key(CONST READER_CAPABILITIES *a,
+	CONST READER_CAPABILITIES *b)
+{
+	return (a->wIdVendor == b->wIdVendor) && (a->wIdProduct == b->wIdProduct)
+		&& (a->FirmwareIDLength == b->FirmwareIDLength)
+		&& (0 == memcmp(a->FirmwareID, b->FirmwareID, a->FirmwareIDLength));
+}
+
+static BOOLEAN load_index(CAPABILITY_INDEX_VARIABLE *index)
+{
+	UINTN Size = sizeof *index;
+	EFI_STATUS Status;
+
+	Status = gRT->GetVariable(CAPABILITY_INDEX, &CapabilityGuid, NULL,
+		&Size, index);
+	if (EFI_ERROR(Status) || (Size != sizeof *index)
+		|| (index->version != CAPABILITY_VERSION)
+		|| (index->count > CAPABILITY_IOCTLS))
+	{
+		ZeroMem(index, sizeof *index);
+		index->version = CAPABILITY_VERSION;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* name of the variable of the reader model of caps */
+static void capability_name(CONST READER_CAPABILITIES *caps, CHAR16 *Name,
+	UINTN Size)
+{
+	UINT32 crc = 0;
+
+	if (caps->FirmwareIDLength)
+		gBS->CalculateCrc32((VOID *)caps->FirmwareID, caps->FirmwareIDLength,
+			&crc);
+
+	UnicodeSPrint(Name, Size, L"ReaderCaps%04X%04X%08X", caps->wIdVendor,
+		caps->wIdProduct, crc);
+}
+
+/* the parts of a record, in order */
+static void record_parts(READER_CAPABILITIES *caps, UINT8 *parts[5],
+	UINT32 *lengths[5], UINTN sizes[5])
+{
+	parts[0] = caps->FirmwareID;
+	lengths[0] = &caps->FirmwareIDLength;
+	sizes[0] = sizeof caps->FirmwareID;
+	parts[1] = caps->features;
+	lengths[1] = &caps->features_length;
+	sizes[1] = sizeof caps->features;
+	parts[2] = caps->properties;
+	lengths[2] = &caps->properties_length;
+	sizes[2] = sizeof caps->properties;
+	parts[3] = caps->mct;
+	lengths[3] = &caps->mct_length;
+	sizes[3] = sizeof caps->mct;
+	parts[4] = caps->pin_properties;
+	lengths[4] = &caps->pin_properties_length;
+	sizes[4] = sizeof caps->pin_properties;
+}
+
+/* read the entry of the reader model with the key of caps */
+static BOOLEAN load_entry(READER_CAPABILITIES *caps)
+{
+	UINT8 buffer[CAPABILITY_RECORD_MAX];
+	CAPABILITY_RECORD *record = (CAPABILITY_RECORD *)buffer;
+	CHAR16 Name[40];
+	UINTN Size = sizeof buffer;
+	UINT8 *parts[5];
+	UINT32 *lengths[5];
+	UINTN sizes[5], offset, i;
+	EFI_STATUS Status;
+
+	capability_name(caps, Name, sizeof Name);
+	Status = gRT->GetVariable(Name, &CapabilityGuid, NULL, &Size, buffer);
+	if (EFI_ERROR(Status) || (Size < sizeof *record)
+		|| (record->version != CAPABILITY_VERSION))
+		return FALSE;
+
+	caps->properties_ioctl = record->properties_ioctl;
+	record_parts(caps, parts, lengths, sizes);
+	offset = sizeof *record;
+	for (i=0; i<5; i++)
+	{
+		if ((record->lengths[i] > sizes[i])
+			|| (offset + record->lengths[i] > Size))
+			return FALSE;
+
+		CopyMem(parts[i], buffer + offset, record->lengths[i]);
+		*lengths[i] = record->lengths[i];
+		offset += record->lengths[i];
+	}
+
+	return TRUE;
+}
+
+/*
+ * Find the capabilities of the reader in the cache. One GET_TLV_PROPERTIES
+ * for each ioctl code of the index, usually one in total.
+ */
+static BOOLEAN LookupCapabilities(RETRY *retry,
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	READER_CAPABILITIES *caps)
+{
+	CAPABILITY_INDEX_VARIABLE index;
+	READER_CAPABILITIES current;
+	UINTN i, length;
+	EFI_STATUS rv;
+
+	if (!load_index(&index))
+		return FALSE;
+
+	/* most recent first */
+	for (i = index.count; i-- > 0; )
+	{
+		length = sizeof current.properties;
+		rv = ControlWithRetry(retry, SmartCardReader, index.ioctls[i], NULL,
+			0, current.properties, &length);
+		if (EFI_ERROR(rv))
+			continue;
+		current.properties_length = (UINT32)length;
+		capability_key(&current);
+
+		ZeroMem(caps, sizeof *caps);
+		caps->wIdVendor = current.wIdVendor;
+		caps->wIdProduct = current.wIdProduct;
+		caps->FirmwareIDLength = current.FirmwareIDLength;
+		CopyMem(caps->FirmwareID, current.FirmwareID,
+			current.FirmwareIDLength);
+
+		if (load_entry(caps)
+			&& (caps->properties_ioctl == index.ioctls[i])
+			&& same_key(caps, &current)
+			&& (caps->properties_length == current.properties_length)
+			&& (0 == memcmp(caps->properties, current.properties,
+				current.properties_length)))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Write the entry of the reader model, if it changed, and add its
+ * GET_TLV_PROPERTIES ioctl code to the index if it is new.
+ */
+static void StoreCapabilities(CONST READER_CAPABILITIES *caps)
+{
+	static READER_CAPABILITIES copy;
+	static UINT8 buffer[CAPABILITY_RECORD_MAX];
+	static UINT8 old[CAPABILITY_RECORD_MAX];
+	CAPABILITY_RECORD *record = (CAPABILITY_RECORD *)buffer;
+	CAPABILITY_INDEX_VARIABLE index;
+	CHAR16 Name[40];
+	UINT8 *parts[5];
+	UINT32 *lengths[5];
+	UINTN sizes[5], offset, i, OldSize = sizeof old;
+	EFI_STATUS Status;
+
+	/* no key */
+	if (0 == caps->properties_ioctl)
+		return;
+
+	copy = *caps;
+	record->version = CAPABILITY_VERSION;
+	record->properties_ioctl = caps->properties_ioctl;
+	record_parts(&copy, parts, lengths, sizes);
+	offset = sizeof *record;
+	for (i=0; i<5; i++)
+	{
+		record->lengths[i] = *lengths[i];
+		CopyMem(buffer + offset, parts[i], *lengths[i]);
+		offset += *lengths[i];
+	}
+
+	capability_name(caps, Name, sizeof Name);
+	Status = gRT->GetVariable(Name, &CapabilityGuid, NULL, &OldSize, old);
+	if (EFI_ERROR(Status) || (OldSize != offset)
+		|| (0 != CompareMem(old, buffer, offset)))
+	{
+		Status = gRT->SetVariable(Name, &CapabilityGuid,
+			EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+			offset, buffer);
+		if (EFI_ERROR(Status))
+		{
+			Print(L"ERROR: SetVariable: %d\n", Status);
+			return;
+		}
+	}
+
+	load_index(&index);
+	for (i=0; i<index.count; i++)
+		if (index.ioctls[i] == caps->properties_ioctl)
+			return;
+
+	if (CAPABILITY_IOCTLS == index.count)
+	{
+		/* forget the oldest */
+		CopyMem(&index.ioctls[0], &index.ioctls[1],
+			(index.count - 1) * sizeof index.ioctls[0]);
+		index.count--;
+	}
+	index.ioctls[index.count++] = caps->properties_ioctl;
+
+	Status = gRT->SetVariable(CAPABILITY_INDEX, &CapabilityGuid,
+		EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+		sizeof index, &index);
+	if (EFI_ERROR(Status))
+		Print(L"ERROR: SetVariable: %d\n", Status);
+}
+
+/* get one answer of the discovery, FALSE if it does not fit the cache */
+static BOOLEAN discover(RETRY *retry,
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader, UINT32 ioctl,
+	unsigned char *send, UINTN send_length,
+	UINT8 *buffer, UINTN size, UINT32 *cached_length)
+{
+	unsigned char *bRecvBuffer;
+	UINTN length = MAX_BUFFER_SIZE;
+	EFI_STATUS rv;
+	BOOLEAN cached = FALSE;
+
+	*cached_length = 0;
+	bRecvBuffer = malloc(MAX_BUFFER_SIZE);
+	if (NULL == bRecvBuffer)
+		return FALSE;
+
+	rv = ControlWithRetry(retry, SmartCardReader, ioctl, send, send_length,
+		bRecvBuffer, &length);
+	if (rv != EFI_SUCCESS)
+		Print(L"SCardControl(0x%X): (0x%lX)\n", ioctl, rv);
+	else
+	if (length > size)
+		Print(L"SCardControl(0x%X): %ld bytes answer not cached\n", ioctl,
+			length);
+	else
+	{
+		memcpy(buffer, bRecvBuffer, length);
+		*cached_length = (UINT32)length;
+		cached = TRUE;
+	}
+
+	free(bRecvBuffer);
+
+	return cached;
+}
+
+/* get the features of the reader and the values that do not change */
+static EFI_STATUS DiscoverCapabilities(RETRY *retry,
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	READER_CAPABILITIES *caps)
+{
+	unsigned char secoder_info[] = { 0x20, 0x70, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00 };
+	PCSC_TLV_STRUCTURE *pcsc_tlv;
+	UINT32 mct_ioctl = 0, pin_properties_ioctl = 0;
+	BOOLEAN complete;
+	UINTN i;
+
+	ZeroMem(caps, sizeof *caps);
+
+	if (!discover(retry, SmartCardReader, CM_IOCTL_GET_FEATURE_REQUEST,
+		NULL, 0, caps->features, sizeof caps->features,
+		&caps->features_length))
+		return EFI_DEVICE_ERROR;
+
+	pcsc_tlv = (PCSC_TLV_STRUCTURE *)caps->features;
+	for (i = 0; i < caps->features_length / sizeof(PCSC_TLV_STRUCTURE); i++)
+	{
+		switch (pcsc_tlv[i].tag)
+		{
+			case FEATURE_GET_TLV_PROPERTIES:
+				caps->properties_ioctl = ntohl(pcsc_tlv[i].value);
+				break;
+			case FEATURE_MCT_READER_DIRECT:
+				mct_ioctl = ntohl(pcsc_tlv[i].value);
+				break;
+			case FEATURE_IFD_PIN_PROPERTIES:
+				pin_properties_ioctl = ntohl(pcsc_tlv[i].value);
+				break;
+		}
+	}
+
+	complete = TRUE;
+	if (caps->properties_ioctl)
+	{
+		complete &= discover(retry, SmartCardReader, caps->properties_ioctl,
+			NULL, 0, caps->properties, sizeof caps->properties,
+			&caps->properties_length);
+		capability_key(caps);
+	}
+	if (mct_ioctl)
+		complete &= discover(retry, SmartCardReader, mct_ioctl,
+			secoder_info, sizeof secoder_info, caps->mct, sizeof caps->mct,
+			&caps->mct_length);
+	if (pin_properties_ioctl)
+		complete &= discover(retry, SmartCardReader, pin_properties_ioctl,
+			NULL, 0, caps->pin_properties, sizeof caps->pin_properties,
+			&caps->pin_properties_length);
+
+	/* do not cache a partial discovery */
+	if (complete)
+		StoreCapabilities(caps);
+
+	return EFI_SUCCESS;
+}
+
 int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 {
 	EFI_STATUS rv;
 	unsigned int i;
-	unsigned char bSendBuffer[MAX_BUFFER_SIZE];
-	unsigned char bRecvBuffer[MAX_BUFFER_SIZE];
+	/* from the malloc() pool, reused for the next reader */
+	unsigned char *bSendBuffer, *bRecvBuffer;
 	int send_length;
 	UINTN length;
 	int verify_ioctl = 0;
 	int modify_ioctl = 0;
-	int pin_properties_ioctl = 0;
-	int mct_readerdirect_ioctl = 0;
-	int properties_in_tlv_ioctl = 0;
-	int ccid_esc_command = 0;
 	PCSC_TLV_STRUCTURE *pcsc_tlv;
+	READER_CAPABILITIES caps;
 #if defined(VERIFY_PIN) | defined(MODIFY_PIN)
 	int offset;
 #endif
@@ -212,20 +635,42 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 	 */
 	int bEntryValidationCondition = 7;
 
+	/*
+	 * Retry the exchanges failing with a transient error. No warm
+	 * reset: it would lose the PIN sent before the "PIN dump" commands.
+	 * The PIN verify and modify commands are not retried since the user
+	 * would have to type the PIN again.
+	 */
+	RETRY retry;
+
+	RetryInit(&retry);
+	retry.policy.warm_reset = FALSE;
+
+	bSendBuffer = malloc(MAX_BUFFER_SIZE);
+	bRecvBuffer = malloc(MAX_BUFFER_SIZE);
+	if ((NULL == bSendBuffer) || (NULL == bRecvBuffer))
+	{
+		Print(L"ERROR: not enough memory\n");
+		goto end;
+	}
+
 	/* does the reader support PIN verification? */
-	length = sizeof bRecvBuffer;
-	rv = SmartCardReader->SCardControl(SmartCardReader,
-			CM_IOCTL_GET_FEATURE_REQUEST, NULL, 0, bRecvBuffer,
-			&length);
-	PCSC_ERROR_EXIT(rv, L"SCardControl")
+	phase("Features");
+	if (!full_discovery && LookupCapabilities(&retry, SmartCardReader, &caps))
+		Print(L"Capabilities of %04X:%04X from the cache\n\n",
+			caps.wIdVendor, caps.wIdProduct);
+	else
+	{
+		rv = DiscoverCapabilities(&retry, SmartCardReader, &caps);
+		PCSC_ERROR_EXIT(rv, L"SCardControl")
+	}
 
+	length = caps.features_length;
 	Print(L" TLV (%ld): ", length);
 	for (i=0; i<length; i++)
-		Print(L"%02X ", bRecvBuffer[i]);
+		Print(L"%02X ", caps.features[i]);
 	Print(L"\n");
 
-	PCSC_ERROR_CONT(rv, L"SCardControl(CM_IOCTL_GET_FEATURE_REQUEST)")
-
 	if (length % sizeof(PCSC_TLV_STRUCTURE))
 	{
 		Print(L"Inconsistent result! Bad TLV values!\n");
@@ -235,7 +680,7 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 	/* get the number of elements instead of the complete size */
 	length /= sizeof(PCSC_TLV_STRUCTURE);
 
-	pcsc_tlv = (PCSC_TLV_STRUCTURE *)bRecvBuffer;
+	pcsc_tlv = (PCSC_TLV_STRUCTURE *)caps.features;
 	for (i = 0; i < length; i++)
 	{
 		switch (pcsc_tlv[i].tag)
@@ -250,20 +695,15 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 				break;
 			case FEATURE_IFD_PIN_PROPERTIES:
 				Print(L"Reader supports FEATURE_IFD_PIN_PROPERTIES\n");
-				pin_properties_ioctl = ntohl(pcsc_tlv[i].value);
 				break;
 			case FEATURE_MCT_READER_DIRECT:
 				Print(L"Reader supports FEATURE_MCT_READER_DIRECT\n");
-				mct_readerdirect_ioctl = ntohl(pcsc_tlv[i].value);
 				break;
 			case FEATURE_GET_TLV_PROPERTIES:
 				Print(L"Reader supports FEATURE_GET_TLV_PROPERTIES\n");
-				properties_in_tlv_ioctl = ntohl(pcsc_tlv[i].value);
 				break;
 			case FEATURE_CCID_ESC_COMMAND:
 				Print(L"Reader supports FEATURE_CCID_ESC_COMMAND\n");
-				ccid_esc_command = ntohl(pcsc_tlv[i].value);
-				(void)ccid_esc_command;
 				break;
 			default:
 				Print(L"Can't parse tag", pcsc_tlv[i].tag);
@@ -271,38 +711,35 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 	}
 	Print(L"\n");
 
-	if (properties_in_tlv_ioctl)
+	if (caps.properties_length)
 	{
 		int value;
 		int ret;
 
-		length = sizeof bRecvBuffer;
-		rv = SmartCardReader->SCardControl(SmartCardReader, properties_in_tlv_ioctl, NULL, 0,
-			bRecvBuffer, &length);
-		PCSC_ERROR_CONT(rv, L"SCardControl(GET_TLV_PROPERTIES)")
-
+		length = caps.properties_length;
 		Print(L"GET_TLV_PROPERTIES (%ld): ", length);
 		for (i=0; i<length; i++)
-			Print(L"%02X ", bRecvBuffer[i]);
+			Print(L"%02X ", caps.properties[i]);
 		Print(L"\n");
 
 		Print(L"\nDisplay all the properties:\n");
-		parse_properties(bRecvBuffer, length);
+		parse_properties(caps.properties, length);
 
+		/* from the same answer, no need to ask the reader again */
 		Print(L"\nFind a specific property:\n");
-		ret = PCSCv2Part10_find_TLV_property_by_tag_from_buffer(bRecvBuffer, length, PCSCv2_PART10_PROPERTY_wIdVendor, &value);
+		ret = PCSCv2Part10_find_TLV_property_by_tag_from_buffer(caps.properties, length, PCSCv2_PART10_PROPERTY_wIdVendor, &value);
 		if (ret)
 			Print(L" wIdVendor: %d\n", ret);
 		else
 			Print(L" wIdVendor: %04X\n", value);
 
-		ret = PCSCv2Part10_find_TLV_property_by_tag_from_protocol(SmartCardReader, PCSCv2_PART10_PROPERTY_wIdProduct, &value);
+		ret = PCSCv2Part10_find_TLV_property_by_tag_from_buffer(caps.properties, length, PCSCv2_PART10_PROPERTY_wIdProduct, &value);
 		if (ret)
 			Print(L" wIdProduct %d\n", ret);
 		else
 			Print(L" wIdProduct: %04X\n", value);
 
-		ret = PCSCv2Part10_find_TLV_property_by_tag_from_protocol(SmartCardReader, PCSCv2_PART10_PROPERTY_bMinPINSize, &value);
+		ret = PCSCv2Part10_find_TLV_property_by_tag_from_buffer(caps.properties, length, PCSCv2_PART10_PROPERTY_bMinPINSize, &value);
 		if (0 == ret)
 		{
 			PIN_min_size = value;
@@ -310,14 +747,14 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 		}
 
 
-		ret = PCSCv2Part10_find_TLV_property_by_tag_from_protocol(SmartCardReader, PCSCv2_PART10_PROPERTY_bMaxPINSize, &value);
+		ret = PCSCv2Part10_find_TLV_property_by_tag_from_buffer(caps.properties, length, PCSCv2_PART10_PROPERTY_bMaxPINSize, &value);
 		if (0 == ret)
 		{
 			PIN_max_size = value;
 			Print(L" PIN max size defined %d\n", PIN_max_size);
 		}
 
-		ret = PCSCv2Part10_find_TLV_property_by_tag_from_protocol(SmartCardReader, PCSCv2_PART10_PROPERTY_bEntryValidationCondition, &value);
+		ret = PCSCv2Part10_find_TLV_property_by_tag_from_buffer(caps.properties, length, PCSCv2_PART10_PROPERTY_bEntryValidationCondition, &value);
 		if (0 == ret)
 		{
 			bEntryValidationCondition = value;
@@ -328,37 +765,26 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 		Print(L"\n");
 	}
 
-	if (mct_readerdirect_ioctl)
+	if (caps.mct_length)
 	{
-		unsigned char secoder_info[] = { 0x20, 0x70, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00 };
-
-		length = sizeof bRecvBuffer;
-		rv = SmartCardReader->SCardControl(SmartCardReader,
-			mct_readerdirect_ioctl, secoder_info, sizeof(secoder_info),
-			bRecvBuffer, &length);
-		PCSC_ERROR_CONT(rv, L"SCardControl(MCT_READER_DIRECT)")
-
+		length = caps.mct_length;
 		Print(L"MCT_READER_DIRECT (%ld): ", length);
 		for (i=0; i<length; i++)
-			Print(L"%02X ", bRecvBuffer[i]);
+			Print(L"%02X ", caps.mct[i]);
 		Print(L"\n");
 	}
 
-	if (pin_properties_ioctl)
+	if (caps.pin_properties_length >= sizeof(PIN_PROPERTIES_STRUCTURE))
 	{
 		PIN_PROPERTIES_STRUCTURE *pin_properties;
 
-		length = sizeof bRecvBuffer;
-		rv = SmartCardReader->SCardControl(SmartCardReader,
-			pin_properties_ioctl, NULL, 0, bRecvBuffer, &length);
-		PCSC_ERROR_CONT(rv, L"SCardControl(pin_properties_ioctl)")
-
+		length = caps.pin_properties_length;
 		Print(L"PIN PROPERTIES (%ld): ", length);
 		for (i=0; i<length; i++)
-			Print(L"%02X ", bRecvBuffer[i]);
+			Print(L"%02X ", caps.pin_properties[i]);
 		Print(L"\n");
 
-		pin_properties = (PIN_PROPERTIES_STRUCTURE *)bRecvBuffer;
+		pin_properties = (PIN_PROPERTIES_STRUCTURE *)caps.pin_properties;
 		Print(L" wLcdLayout %04X\n", pin_properties -> wLcdLayout);
 		Print(L" bEntryValidationCondition %d\n", pin_properties ->	bEntryValidationCondition);
 		Print(L" bTimeOut2 %d\n", pin_properties -> bTimeOut2);
@@ -373,6 +799,7 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 	}
 
 	/* SCardConnect */
+	phase("Connect");
 	rv = SmartCardReader->SCardConnect(SmartCardReader,
 		SCARD_AM_CARD,
 		SCARD_CA_COLDRESET,
@@ -388,8 +815,8 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 	for (i=0; i<send_length; i++)
 		Print(L" %02X", bSendBuffer[i]);
 	Print(L"\n");
-	length = sizeof(bRecvBuffer);
-	rv = SmartCardReader->SCardTransmit(SmartCardReader,
+	length = MAX_BUFFER_SIZE;
+	rv = TransmitWithRetry(&retry, SmartCardReader,
 		bSendBuffer, send_length, bRecvBuffer, &length);
 	PCSC_ERROR_EXIT(rv, L"SCardTransmit")
 	Print(L" card response:");
@@ -404,6 +831,7 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 
 #ifdef VERIFY_PIN
 	/* verify PIN */
+	phase("Verify PIN");
 	Print(L" Secure verify PIN\n");
 	pin_verify = (PIN_VERIFY_STRUCTURE *)bSendBuffer;
 
@@ -447,7 +875,7 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 		Print(L" %02X", bSendBuffer[i]);
 	Print(L"\n");
 	Print(L"Enter your PIN: \n");
-	length = sizeof bRecvBuffer;
+	length = MAX_BUFFER_SIZE;
 	rv = SmartCardReader->SCardControl(SmartCardReader, verify_ioctl,
 		bSendBuffer, send_length, bRecvBuffer, &length);
 
@@ -465,8 +893,8 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 	for (i=0; i<send_length; i++)
 		Print(L" %02X", bSendBuffer[i]);
 	Print(L"\n");
-	length = sizeof(bRecvBuffer);
-	rv = SmartCardReader->SCardTransmit(SmartCardReader, bSendBuffer, send_length,
+	length = MAX_BUFFER_SIZE;
+	rv = TransmitWithRetry(&retry, SmartCardReader, bSendBuffer, send_length,
 		bRecvBuffer, &length);
 	PCSC_ERROR_EXIT(rv, L"SCardTransmit")
 	Print(L" card response:");
@@ -484,8 +912,8 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 		for (i=0; i<send_length; i++)
 			Print(L" %02X", bSendBuffer[i]);
 		Print(L"\n");
-		length = sizeof(bRecvBuffer);
-		rv = SmartCardReader->SCardTransmit(SmartCardReader, bSendBuffer, send_length,
+		length = MAX_BUFFER_SIZE;
+		rv = TransmitWithRetry(&retry, SmartCardReader, bSendBuffer, send_length,
 			bRecvBuffer, &length);
 		PCSC_ERROR_EXIT(rv, L"SCardTransmit")
 		Print(L" card response:");
@@ -504,6 +932,7 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 
 #ifdef MODIFY_PIN
 	/* Modify PIN */
+	phase("Modify PIN");
 	Print(L" Secure modify PIN\n");
 	pin_modify = (PIN_MODIFY_STRUCTURE *)bSendBuffer;
 
@@ -564,7 +993,7 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 		Print(L" %02X", bSendBuffer[i]);
 	Print(L"\n");
 	Print(L"Enter your PIN: \n");
-	length = sizeof bRecvBuffer;
+	length = MAX_BUFFER_SIZE;
 	rv = SmartCardReader->SCardControl(SmartCardReader, modify_ioctl,
 		bSendBuffer, send_length, bRecvBuffer, &length);
 
@@ -582,8 +1011,8 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 	for (i=0; i<send_length; i++)
 		Print(L" %02X", bSendBuffer[i]);
 	Print(L"\n");
-	length = sizeof(bRecvBuffer);
-	rv = SmartCardReader->SCardTransmit(SmartCardReader, bSendBuffer, send_length,
+	length = MAX_BUFFER_SIZE;
+	rv = TransmitWithRetry(&retry, SmartCardReader, bSendBuffer, send_length,
 		bRecvBuffer, &length);
 	PCSC_ERROR_EXIT(rv, L"SCardTransmit")
 	Print(L" card response:");
@@ -601,8 +1030,8 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 		for (i=0; i<send_length; i++)
 			Print(L" %02X", bSendBuffer[i]);
 		Print(L"\n");
-		length = sizeof(bRecvBuffer);
-		rv = SmartCardReader->SCardTransmit(SmartCardReader, bSendBuffer, send_length,
+		length = MAX_BUFFER_SIZE;
+		rv = TransmitWithRetry(&retry, SmartCardReader, bSendBuffer, send_length,
 			bRecvBuffer, &length);
 		PCSC_ERROR_EXIT(rv, L"SCardTransmit")
 		Print(L" card response:");
@@ -613,10 +1042,16 @@ int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 #endif
 
 	/* card disconnect */
+	phase("Disconnect");
 	rv = SmartCardReader->SCardDisconnect(SmartCardReader, SCARD_CA_NORESET);
 	PCSC_ERROR_CONT(rv, L"SCardDisconnect")
 
 end:
+	phase(NULL);
+	RetryPrintStats(&retry);
+	free(bSendBuffer);
+	free(bRecvBuffer);
+
 	return 0;
 } /* Check */
 
@@ -633,25 +1068,40 @@ ShellAppMain (
 	EFI_HANDLE  *DevicePathHandleBuffer = NULL;
 	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader;
 	int reader = -1;
+	UINTN i;
 
 	Print(L"SCardControl sample code\n");
 	Print(L"V 1.4 © 2004-2014, Ludovic Rousseau <ludovic.rousseau@free.fr>\n\n");
 
-	if (Argc > 1)
-		reader = StrDecimalToUintn(Argv[1]);
+	/* scardcontrol [reader] [f] [p] */
+	for (i=1; i<Argc; i++)
+	{
+		if ('f' == Argv[i][0])
+			full_discovery = TRUE;
+		else
+		if ('p' == Argv[i][0])
+			PoolPoison(TRUE);
+		else
+			reader = StrDecimalToUintn(Argv[i]);
+	}
+
+	/* before any measure */
+	StopwatchInit();
 
 	/* EFI_SMART_CARD_READER_PROTOCOL */
+	PERF_INMODULE_BEGIN("Enumerate");
 	Status = gBS->LocateHandleBuffer(
 			ByProtocol,
 			&gEfiSmartCardReaderProtocolGuid,
 			NULL,
 			&HandleCount,
 			&DevicePathHandleBuffer);
+	PERF_INMODULE_END("Enumerate");
 
 	if (EFI_ERROR(Status))
 	{
 		Print(L"ERROR: Get EFI_SMART_CARD_READER_PROTOCOL count fail.\n");
-		return 0;
+		goto end;
 	}
 
 	Print(L"Found %d reader(s)\n", HandleCount);
@@ -667,8 +1117,7 @@ ShellAppMain (
 		if (EFI_ERROR(Status))
 		{
 			Print(L"ERROR: Open UsbIo fail.\n");
-			gBS->FreePool(DevicePathHandleBuffer);
-			return 0;
+			goto end;
 		}
 
 		Print(L"reader %d\n", HandleIndex);
@@ -676,7 +1125,14 @@ ShellAppMain (
 		if (reader < 0 || reader == HandleIndex)
 			CheckReader(SmartCardReader);
 	}
-	gBS->FreePool(DevicePathHandleBuffer);
+
+end:
+	if (DevicePathHandleBuffer)
+		gBS->FreePool(DevicePathHandleBuffer);
+
+	/* the pool memory of an application is not freed when it exits */
+	PoolPrintStats();
+	PoolFlush();
 
 	return 0;
 }
@@ -0,0 +1,115 @@
+/*
+    scstat.c: print the statistics of the smart card readers
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 51
+	Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Usage: scstat [h] [r]
+ *
+ * Print the counters collected by the ReaderStats driver for each
+ * reader and each function of EFI_SMART_CARD_READER_PROTOCOL.
+ * h   also print the latency histograms
+ * r   reset the counters after printing them
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/ShellCEntryLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+
+#include "../ReaderStats.h"
+
+static EFI_GUID gReaderStatsProtocolGuid = READER_STATS_PROTOCOL_GUID;
+
+static CONST CHAR16 *function_names[STATS_FUNCTIONS] = {
+	L"SCardConnect", L"SCardDisconnect", L"SCardStatus",
+	L"SCardTransmit", L"SCardControl", L"SCardGetAttrib" };
+
+static void PrintStats(CONST READER_STATS *Stats, BOOLEAN histogram)
+{
+	UINTN i;
+
+	Print(L"reader %d (%s)\n", Stats->index, Stats->ReaderName);
+
+	for (i=0; i<STATS_FUNCTIONS; i++)
+	{
+		CONST FUNCTION_STATS *f = &Stats->functions[i];
+
+		if (0 == f->calls)
+			continue;
+
+		Print(L"  %-16s %ld call(s), %ld error(s), sent %ld, received %ld bytes\n",
+			function_names[i], f->calls, f->errors, f->bytes_sent,
+			f->bytes_received);
+		HistogramPrint(&f->latency, 19, histogram);
+	}
+}
+
+INTN
+EFIAPI
+ShellAppMain (
+  IN UINTN Argc,
+  IN CHAR16 **Argv
+  )
+{
+	EFI_STATUS Status;
+	READER_STATS_PROTOCOL *ReaderStats;
+	READER_STATS Stats;
+	BOOLEAN histogram = FALSE, reset = FALSE;
+	UINTN i;
+
+	for (i=1; i<Argc; i++)
+	{
+		switch (Argv[i][0])
+		{
+			case 'h':
+				histogram = TRUE;
+				break;
+
+			case 'r':
+				reset = TRUE;
+				break;
+
+			default:
+				Print(L"Usage: scstat [h] [r]\n");
+				return 1;
+		}
+	}
+
+	Status = gBS->LocateProtocol(&gReaderStatsProtocolGuid, NULL,
+		(VOID **)&ReaderStats);
+	if (EFI_ERROR(Status))
+	{
+		Print(L"ERROR: load ReaderStats.efi first\n");
+		return 1;
+	}
+
+	for (i=0; !EFI_ERROR(ReaderStats->GetStats(ReaderStats, i, &Stats)); i++)
+		PrintStats(&Stats, histogram);
+
+	if (0 == i)
+		Print(L"No reader\n");
+
+	if (reset)
+	{
+		ReaderStats->Reset(ReaderStats);
+		Print(L"Counters reset\n");
+	}
+
+	return 0;
+}
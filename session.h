@@ -0,0 +1,93 @@
+/*
+    session.h: per card session parameters cached by ATR
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __SESSION_H__
+#define __SESSION_H__
+
+#define SESSION_ATR_MAX 33
+#define SESSION_AID_MAX 16
+#define SESSION_ENTRIES 8
+
+/* what worked the last time for a card, identified by its ATR */
+typedef struct
+{
+	UINT8 Atr[SESSION_ATR_MAX];
+	UINT8 AtrLength;
+	UINT8 Aid[SESSION_AID_MAX];	/**< last application selected */
+	UINT8 AidLength;
+	UINT32 protocol;		/**< active protocol */
+	UINT32 IFSC;			/**< T=1 IFSC given by the reader, 0 if unknown */
+	INT32 max_length[4];	/**< short Lc, short Le, extended Lc, extended Le, -1 if unknown */
+	UINT32 transport;		/**< faster transport of the long APDUs, see TransmitLarge() */
+	UINT32 uses;			/**< connections with this entry */
+} SESSION_ENTRY;
+
+/* session of one reader */
+typedef struct
+{
+	SESSION_ENTRY entry;
+	BOOLEAN cached;			/**< entry found in the cache */
+	BOOLEAN fallback;		/**< the cached protocol was refused */
+	BOOLEAN connected;		/**< SessionConnect() succeeded */
+} SESSION;
+
+/* content of the non volatile variable "SessionCache" */
+typedef struct
+{
+	UINT32 version;
+	UINT32 count;
+	SESSION_ENTRY entries[SESSION_ENTRIES];	/**< least recently used first */
+} SESSION_CACHE;
+
+/*
+ * Load and save the cache variable. These functions use the runtime
+ * services, or Print(), so they are for the BSP only. A missing or old
+ * variable gives an empty cache.
+ */
+EFI_STATUS SessionCacheLoad(SESSION_CACHE *Cache);
+EFI_STATUS SessionCacheSave(CONST SESSION_CACHE *Cache);
+void SessionPrint(CONST SESSION *Session);
+
+/*
+ * The functions below use no boot services and do not Print() so they
+ * can be called from an application processor.
+ */
+
+/* start the session of the card with this ATR, from the cache if known */
+void SessionLookup(CONST SESSION_CACHE *Cache, CONST UINT8 *Atr,
+	UINTN AtrLength, SESSION *Session);
+
+/*
+ * SCardConnect() with only the cached protocol, then with T=0 and T=1
+ * if the card refuses it. The active protocol and the IFSC are saved in
+ * the session.
+ */
+EFI_STATUS SessionConnect(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	UINT32 CardAction, SESSION *Session, UINT32 *ActiveProtocol);
+
+void SessionSetAid(SESSION *Session, CONST UINT8 *Aid, UINTN AidLength);
+
+/*
+ * Add the session to the cache, replacing the least recently used entry.
+ * Return TRUE if an entry was added or its parameters changed: the use
+ * count and the order alone are not worth a write of the variable.
+ */
+BOOLEAN SessionUpdate(SESSION_CACHE *Cache, CONST SESSION *Session);
+
+#endif
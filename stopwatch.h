@@ -0,0 +1,80 @@
+/*
+    stopwatch.h: calibrated timestamps and latency histograms
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __STOPWATCH_H__
+#define __STOPWATCH_H__
+
+/* bucket i counts the values of [2^i, 2^(i+1)[ us, bucket 0 is [0, 2[ us */
+#define HISTOGRAM_BUCKETS 24
+
+typedef struct
+{
+	UINT64 count;
+	UINT64 total_ns;
+	UINT64 min_ns;
+	UINT64 max_ns;
+	UINT64 buckets[HISTOGRAM_BUCKETS];
+} HISTOGRAM;
+
+typedef struct
+{
+	UINT64 start;		/**< StopwatchNow() of StopwatchStart() */
+} STOPWATCH;
+
+/*
+ * Calibrate the time stamp counter against gBS->Stall(). Call it once
+ * from the BSP before using the other functions. Without calibration
+ * the TimerLib performance counter is used.
+ */
+EFI_STATUS StopwatchInit(void);
+
+/* frequency of the counter used, in Hz */
+UINT64 StopwatchFrequency(void);
+
+/*
+ * The following functions use no boot services so they can be called
+ * from an application processor.
+ */
+
+/* current value of the counter, always counting up */
+UINT64 StopwatchNow(void);
+
+/* counter ticks from begin to end, two StopwatchNow() values, across a
+ * wraparound of the performance counter */
+UINT64 StopwatchElapsed(UINT64 begin, UINT64 end);
+
+/* counter ticks to ns */
+UINT64 StopwatchTicksToNs(UINT64 ticks);
+
+void StopwatchStart(STOPWATCH *sw);
+
+/* ns since StopwatchStart() */
+UINT64 StopwatchStop(STOPWATCH *sw);
+
+void HistogramReset(HISTOGRAM *h);
+void HistogramAdd(HISTOGRAM *h, UINT64 ns);
+void HistogramMerge(HISTOGRAM *to, CONST HISTOGRAM *from);
+
+/* percent-th value in us, interpolated in its bucket */
+UINT64 HistogramPercentile(CONST HISTOGRAM *h, UINTN percent);
+
+/* print min/avg/max and the non empty buckets, indented by indent */
+void HistogramPrint(CONST HISTOGRAM *h, UINTN indent, BOOLEAN buckets);
+
+#endif
@@ -0,0 +1,102 @@
+/*
+    transmit.h: SCardTransmit/SCardControl with a retry policy
+    Copyright (C) 2026   Ludovic Rousseau
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __TRANSMIT_H__
+#define __TRANSMIT_H__
+
+/* called after a warm reset of the card, to select the applet again */
+typedef EFI_STATUS (*RECONNECT_CALLBACK)(VOID *Context);
+
+/* how a failed exchange is retried */
+typedef struct
+{
+	UINTN max_attempts;		/**< attempts per exchange, 1 = no retry */
+	UINTN backoff_us;		/**< delay before the first retry, doubled each retry */
+	UINTN max_backoff_us;	/**< upper limit of the delay */
+	BOOLEAN warm_reset;		/**< reconnect with a warm reset before the last attempts */
+	UINT64 budget_us;		/**< total time spent recovering, 0 = no limit */
+} RETRY_POLICY;
+
+/* counters of the recoveries */
+typedef struct
+{
+	UINTN exchanges;		/**< calls to TransmitWithRetry/ControlWithRetry */
+	UINTN retries;			/**< attempts after the first one */
+	UINTN reconnects;		/**< warm resets */
+	UINTN recovered;		/**< exchanges that succeeded after a retry */
+	UINTN failed;			/**< exchanges that failed after all the attempts */
+	UINTN over_budget;		/**< exchanges not retried because the budget is spent */
+	UINT64 recovery_ns;		/**< time spent in retries, delays and reconnects */
+} RETRY_STATS;
+
+/* retry state of one reader */
+typedef struct
+{
+	RETRY_POLICY policy;
+	RETRY_STATS stats;
+	RECONNECT_CALLBACK Reconnected;	/**< may be NULL */
+	VOID *Context;					/**< passed to Reconnected */
+} RETRY;
+
+/*
+ * Default policy: 3 attempts, 1 ms backoff up to 100 ms, warm reset
+ * and 10 s of recovery time per reader.
+ */
+void RetryInit(RETRY *Retry);
+
+/* no retry: behave like a direct call to the protocol */
+void RetryDisable(RETRY *Retry);
+
+/*
+ * Transient errors (EFI_TIMEOUT, EFI_DEVICE_ERROR, EFI_NO_MEDIA and
+ * EFI_NOT_READY) are retried according to the policy. The other errors
+ * are returned immediately.
+ * These functions use no boot services and do not Print() so they can
+ * be called from an application processor.
+ */
+EFI_STATUS TransmitWithRetry(RETRY *Retry,
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	UINT8 *CAPDU, UINTN CAPDULength,
+	UINT8 *RAPDU, UINTN *RAPDULength);
+
+/* how TransmitLarge() sends an extended APDU */
+#define TRANSPORT_EXTENDED 0	/**< as is */
+#define TRANSPORT_CHAINING 1	/**< ISO 7816-4 command chaining and GET RESPONSE */
+
+/*
+ * Send an APDU given in the extended form with the transport. With
+ * TRANSPORT_CHAINING the data is split in chained commands of 255 bytes
+ * and the response is collected with GET RESPONSE while the card
+ * answers 61xx; the exchanges are retried like TransmitWithRetry().
+ */
+EFI_STATUS TransmitLarge(RETRY *Retry,
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader, UINTN Transport,
+	UINT8 *CAPDU, UINTN CAPDULength,
+	UINT8 *RAPDU, UINTN *RAPDULength);
+
+EFI_STATUS ControlWithRetry(RETRY *Retry,
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	UINT32 ControlCode,
+	UINT8 *InBuffer, UINTN InBufferLength,
+	UINT8 *OutBuffer, UINTN *OutBufferLength);
+
+/* print the counters, if any retry was needed */
+void RetryPrintStats(CONST RETRY *Retry);
+
+#endif
@@ -24,18 +24,50 @@
 #include <Uefi.h>
 #include <Library/UefiLib.h>
 #include <Library/ShellCEntryLib.h>
+#include <Library/ShellLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/SynchronizationLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+#include <Library/PrintLib.h>
+#include <Library/PerformanceLib.h>
 #include <Protocol/SmartCardReader.h>
+#include <Protocol/MpService.h>
 
 #define UEFI_DRIVER
-//#include "reader.h"
+#include "../reader.h"
+#include "../transmit.h"
+#include "../stopwatch.h"
+#include "../session.h"
 
 int cases = 0;
 int extended = FALSE;
 int timerequest = -1;
 int apdu = 0;
 int tpdu = 1;
+int parallel = FALSE;
+int sharded = FALSE;
+int resume = FALSE;
+int probe = FALSE;
+int sampled = FALSE;
+UINT32 seed = 0;
+int fresh_session = FALSE;
+int benchmark = FALSE;
+int transports = FALSE;
+int cached_transport = FALSE;
+int contactless = FALSE;
+int combi = FALSE;
+int binary = FALSE;
+int report = FALSE;
+CHAR16 *baseline_save = NULL;
+CHAR16 *baseline_load = NULL;
+/* regression threshold of each Case, in % */
+UINTN threshold[4] = { 10, 10, 10, 10 };
+RETRY retry_policy;
+
+/* protocol, AID and APDU lengths used the last time, by ATR */
+static SESSION_CACHE session_cache;
 
 #define MAX_BUFFER_SIZE_EXTENDED    (4 + 3 + (1<<16) + 3 + 2)   /**< enhanced (64K + APDU + Lc + Le + SW) Tx/Rx Buffer */
 #define MAX_BUFFER_SIZE (4 + 3 + (1<<8) + 3 + 2)
@@ -45,166 +77,348 @@ int tpdu = 1;
 #define CASE3 (1<<2)
 #define CASE4 (1<<3)
 
-#define PCSC_ERROR(x) Print(L"%a:%d " x ": %d\n", __FILE__, __LINE__, rv)
+/* payload sizes of the transport benchmark */
+static const int transport_sizes[] = { 256, 1024, 4096, 16384, 65535 };
+#define TRANSPORT_SIZES (sizeof transport_sizes / sizeof transport_sizes[0])
 
-int exchange(const char *text, EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+/* sizes of the contactless READ/UPDATE BINARY benchmark */
+static const int binary_sizes[] = { 16, 64, 128, 255, 1024, 4096, 16384, 65535 };
+#define BINARY_SIZES (sizeof binary_sizes / sizeof binary_sizes[0])
+
+/* commands of each size, the average time is kept */
+#define BINARY_ROUNDS 8
+
+/* runs of the short APDU workload of each reader in report mode */
+#define REPORT_ROUNDS 4
+
+/* result of a Case of a reader in a baseline file */
+typedef struct
+{
+	CHAR16 ReaderName[100];
+	UINTN index;		/**< reader number */
+	UINTN test_case;	/**< 1 to 4 */
+	UINT64 count;		/**< APDUs */
+	UINT64 avg_ns;		/**< average latency */
+	UINT64 throughput;	/**< bytes/s */
+} BASELINE;
+
+#define BASELINE_MAX 64
+
+static BASELINE baseline[BASELINE_MAX];
+static UINTN nb_baseline;
+
+/* exit code if a Case is slower than in the baseline */
+#define EXIT_REGRESSION 2
+
+/* measures of one protocol in benchmark mode */
+typedef struct
+{
+	int done;			/**< the card accepted the protocol */
+	int result;			/**< 0 if the workload passed */
+	HISTOGRAM latency[4];	/**< of each Case */
+	UINT64 bytes[4];	/**< command and response bytes of each Case */
+} BENCH;
+
+/* state and result of the test of one reader */
+typedef struct
+{
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader;
+	UINTN index;		/**< reader number */
+	int quiet;			/**< do not Print(), used when running on an AP */
+	unsigned char *s;	/**< command buffer */
+	unsigned char *r;	/**< response buffer */
+	unsigned char *e;	/**< expected response buffer */
+	CHAR16 ReaderName[100];
+	unsigned int exchanges;	/**< number of APDUs sent */
+	int result;			/**< 0 if all the tests passed */
+	const char *failed_text;	/**< test that failed */
+	unsigned int failed_s_length, failed_e_length;
+	EFI_STATUS failed_status;
+	UINTN shard;		/**< shard of the length sweep */
+	unsigned int lengths[2];	/**< Case 3 and Case 2 lengths passed */
+	unsigned int steals;	/**< lengths taken from other shards */
+	int max_length[4];	/**< short Lc, short Le, extended Lc, extended Le */
+	unsigned int boundary[2];	/**< Case 3 and Case 2 boundary lengths tested */
+	unsigned int random[2];	/**< Case 3 and Case 2 random lengths tested */
+	RETRY retry;		/**< retries of the failed exchanges */
+	SESSION session;	/**< parameters of the card, see session.h */
+	BENCH bench[2];		/**< T=0 and T=1 benchmark */
+	BENCH *measured;	/**< protocol being measured, or NULL */
+	int measured_case;	/**< Case being measured, 0 for none */
+	UINTN transport;	/**< TRANSPORT_EXTENDED or TRANSPORT_CHAINING */
+	/** ns to send [Case 3] or receive [Case 2] a payload with each
+	 * transport, 0 if it failed */
+	UINT64 transport_ns[TRANSPORT_SIZES][2][2];
+	/** ns of an UPDATE [0] and READ [1] BINARY of each size, 0 if it
+	 * failed */
+	UINT64 binary_ns[BINARY_SIZES][2];
+	BENCH report;		/**< exchanges of the report workload */
+	UINT64 report_ns;	/**< time of the report workload, without recovery */
+	unsigned int report_failed;	/**< failed runs of the report workload */
+	UINT64 checkpoint_time;	/**< StopwatchNow() of the last checkpoint */
+	char phase[40];		/**< PERF marker of the running phase */
+} READER_CONTEXT;
+
+/* lengths [next, end[ of a shard of the extended APDU sweep */
+typedef struct
+{
+	UINT32 next;
+	UINT32 end;
+} SHARD;
+
+/* extended APDU sweep shared by several readers */
+static struct
+{
+	SPIN_LOCK lock;
+	UINT32 nb_case3;	/**< items [0, nb_case3[ are Case 3 */
+	UINT32 nb_items;	/**< items [nb_case3, nb_items[ are Case 2 */
+	SHARD *shards;
+	UINTN nb_shards;
+} sweep;
+
+/* save the progress of the extended sweep every CHECKPOINT_SECONDS, each
+ * save is a write of the NV store */
+#define CHECKPOINT_SECONDS 60
+
+/* firmware watchdog timeout, in seconds, re-armed before each length */
+#define WATCHDOG_TIMEOUT (5*60)
+
+/* progress of the extended APDU sweep of one reader */
+typedef struct
+{
+	UINT32 version;		/**< CHECKPOINT_VERSION */
+	UINT32 test_case;	/**< CASE3 or CASE2 */
+	UINT32 length;		/**< next length to test */
+	UINT32 exchanges;	/**< APDUs already sent */
+	CHAR16 ReaderName[100];
+} CHECKPOINT;
+
+#define CHECKPOINT_VERSION 1
+
+/* in sampled mode, test 1 length out of SAMPLE_RATE outside boundaries */
+#define SAMPLE_RATE 64
+
+/* USB full speed bulk packet size */
+#define USB_PACKET_SIZE 64
+
+/* CCID bulk message header */
+#define CCID_HEADER_SIZE 10
+
+/* vendor GUID of the checkpoint variables */
+static EFI_GUID CheckpointGuid =
+	{ 0x7d4bd3b0, 0x2c8f, 0x4e51, { 0x9a, 0x63, 0x1e, 0x5b, 0x80, 0xc4, 0x27, 0xd9 } };
+
+#define LOG(ctx, ...) do { if (!(ctx)->quiet) Print(__VA_ARGS__); } while (0)
+
+#define PCSC_ERROR(ctx, x) LOG(ctx, L"%a:%d " x ": %d\n", __FILE__, __LINE__, rv)
+
+/*
+ * End the running phase and start the next one, NULL to only end it.
+ * The PERF records go to the firmware performance table, see fpdtview.
+ * Not on an AP: the performance protocol is not MP safe.
+ */
+static void phase(READER_CONTEXT *ctx, const char *name)
+{
+	if (ctx->quiet)
+		return;
+
+	if (ctx->phase[0])
+		PERF_INMODULE_END(ctx->phase);
+	ctx->phase[0] = '\0';
+
+	if (name)
+	{
+		AsciiSPrint(ctx->phase, sizeof ctx->phase, "Reader%d %a",
+			ctx->index, name);
+		PERF_INMODULE_BEGIN(ctx->phase);
+	}
+}
+
+/* record the first failure of a reader */
+static int failure(READER_CONTEXT *ctx, const char *text,
+	unsigned int s_length, unsigned int e_length, EFI_STATUS Status)
+{
+	if (0 == ctx->result)
+	{
+		ctx->result = 1;
+		ctx->failed_text = text;
+		ctx->failed_s_length = s_length;
+		ctx->failed_e_length = e_length;
+		ctx->failed_status = Status;
+	}
+
+	return 1;
+}
+
+/*
+ * Expected response: length bytes given 8 at a time by word(), then
+ * 90 00. The response is compared without building it in memory.
+ */
+typedef struct
+{
+	UINT64 (*word)(UINTN offset, UINT8 value);	/**< bytes [offset, offset+8[, little endian */
+	UINT8 value;
+	unsigned int length;
+} GENERATOR;
+
+/* every byte is value */
+static UINT64 constant_word(UINTN offset, UINT8 value)
+{
+	return MultU64x32(0x0101010101010101ULL, value);
+}
+
+/* byte i is (value + i) & 0xFF: 00 01 02 ... for value 0 */
+static UINT64 ramp_word(UINTN offset, UINT8 value)
+{
+	UINT8 first = (UINT8)(offset + value);
+	UINT64 word = 0;
+	int k;
+
+	/* no carry between the bytes */
+	if (first <= 0xF8)
+		return MultU64x32(0x0101010101010101ULL, first)
+			+ 0x0706050403020100ULL;
+
+	for (k=7; k>=0; k--)
+		word = LShiftU64(word, 8) | (UINT8)(first + k);
+
+	return word;
+}
+
+/* index of the first byte of r different from the generator, or -1 */
+static INTN verify(CONST GENERATOR *g, CONST UINT8 *r)
+{
+	UINTN i, k;
+	UINT64 expected;
+
+	for (i=0; i < g->length; i += 8)
+	{
+		expected = g->word(i, g->value);
+
+		/* wide compare of a full word */
+		if ((i + 8 <= g->length) && (ReadUnaligned64((CONST UINT64 *)(r + i))
+			== expected))
+			continue;
+
+		for (k=0; (k < 8) && (i + k < g->length); k++)
+			if (r[i + k] != (UINT8)RShiftU64(expected, 8*k))
+				return i + k;
+	}
+
+	if ((0x90 != r[g->length]) || (0x00 != r[g->length + 1]))
+		return g->length;
+
+	return -1;
+}
+
+/* expected byte i of the generator, status word included */
+static UINT8 generated(CONST GENERATOR *g, UINTN i)
+{
+	if (i >= g->length)
+		return (i == g->length) ? 0x90 : 0x00;
+
+	return (UINT8)RShiftU64(g->word(i & ~(UINTN)7, g->value), 8 * (i & 7));
+}
+
+/* check the response against e[] or, if e is NULL, against g */
+static int check_exchange(const char *text, READER_CONTEXT *ctx,
 	unsigned char s[], unsigned int s_length,
 	unsigned char r[], UINTN * r_length,
-	unsigned char e[], unsigned int e_length)
+	unsigned char e[], CONST GENERATOR *g, unsigned int e_length)
 {
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader = ctx->SmartCardReader;
 	int rv;
-#ifndef CONTACTLESS
+	STOPWATCH sw;
+	UINT64 ns;
 	unsigned int i;
-#else
-	(void)e;
-#endif
+	INTN bad;
 
-	Print(L"\n%a (%d, %d)\n", text, s_length, e_length);
+	LOG(ctx, L"\n%a (%d, %d)\n", text, s_length, e_length);
 	//log_xxd(0, "Sent: ", s, s_length);
 
-	rv = SmartCardReader->SCardTransmit(SmartCardReader, s, s_length, r, r_length);
+	StopwatchStart(&sw);
+	rv = TransmitLarge(&ctx->retry, SmartCardReader, ctx->transport,
+		s, s_length, r, r_length);
+	ns = StopwatchStop(&sw);
+	ctx->exchanges++;
+
+	if (ctx->measured && ctx->measured_case && !rv)
+	{
+		HistogramAdd(&ctx->measured->latency[ctx->measured_case - 1], ns);
+		ctx->measured->bytes[ctx->measured_case - 1] += s_length + *r_length;
+	}
 
 	//log_msg("Received %lu (0x%04lX) bytes", *r_length, *r_length);
 	//log_xxd("Received: ", r, *r_length);
 	if (rv)
 	{
-		PCSC_ERROR("IFDHTransmitToICC");
-		return 1;
+		PCSC_ERROR(ctx, "IFDHTransmitToICC");
+		return failure(ctx, text, s_length, e_length, rv);
 	}
 
 	/* check the received length */
 	if (*r_length != e_length)
 	{
-		Print(L"ERROR: Expected %d bytes and received %d\n",
+		LOG(ctx, L"ERROR: Expected %d bytes and received %d\n",
 			e_length, *r_length);
-		return 1;
+		return failure(ctx, text, s_length, e_length, EFI_SUCCESS);
 	}
 
-#ifndef CONTACTLESS
-	/* check the received data */
-	for (i=0; i<e_length; i++)
-		if (r[i] != e[i])
+	/* check the received data, the contactless files are not known */
+	if (!contactless)
+	{
+		if (NULL == e)
 		{
-			Print(L"ERROR byte %d: expected 0x%02X, got 0x%02X\n",
-				i, e[i], r[i]);
-			return 1;
-			break;
+			bad = verify(g, r);
+			if (bad >= 0)
+			{
+				LOG(ctx, L"ERROR byte %d: expected 0x%02X, got 0x%02X\n",
+					bad, generated(g, bad), r[bad]);
+				return failure(ctx, text, s_length, e_length, EFI_SUCCESS);
+			}
 		}
-#endif
+		else
+		for (i=0; i<e_length; i++)
+			if (r[i] != e[i])
+			{
+				LOG(ctx, L"ERROR byte %d: expected 0x%02X, got 0x%02X\n",
+					i, e[i], r[i]);
+				return failure(ctx, text, s_length, e_length, EFI_SUCCESS);
+				break;
+			}
+	}
 
-	Print(L"--------> OK\n");
+	LOG(ctx, L"--------> OK\n");
 
 	return 0;
-} /* exchange */
+} /* check_exchange */
 
-int extended_apdu(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
+int exchange(const char *text, READER_CONTEXT *ctx,
+	unsigned char s[], unsigned int s_length,
+	unsigned char r[], UINTN * r_length,
+	unsigned char e[], unsigned int e_length)
 {
-	int i, len_i, len_o;
-	unsigned char s[MAX_BUFFER_SIZE_EXTENDED], r[MAX_BUFFER_SIZE_EXTENDED];
-	UINTN dwSendLength, dwRecvLength;
-	unsigned char e[MAX_BUFFER_SIZE_EXTENDED];	// expected result
-	int e_length;	// expected result length
-	const char *text = NULL;
-	int start, end;
-
-	if (cases & CASE3)
-	{
-		/* Case 3 */
-		text = "Case 3: CLA INS P1 P2 Lc Data, L(Cmd) = 5 + Lc";
-		end = 65535;
-		start = 1;
-
-		for (len_i = start; len_i <= end; len_i++)
-		{
-#ifdef CONTACTLESS
-			s[0] = 0x00;
-			s[1] = 0xD6;
-			s[2] = 0x00;
-			s[3] = 0x00;
-#else
-			s[0] = 0x80;
-			s[1] = 0x12;
-			s[2] = 0x01;
-			s[3] = 0x80;
-#endif
-			s[4] = 0x00;	/* extended */
-			s[5] = len_i >> 8;
-			s[6] = len_i;
-
-			for (i=0; i<len_i; i++)
-				s[7+i] = i;
-
-			dwSendLength = len_i + 7;
-			dwRecvLength = sizeof(r);
-
-			e[0] = 0x90;
-			e[1] = 0x00;
-			e_length = 2;
-
-			if (exchange(text, SmartCardReader,
-				s, dwSendLength, r, &dwRecvLength, e, e_length))
-				return 1;
-		}
-	}
-
-	if (cases & CASE2)
-	{
-		/* Case 2 */
-		/*
-		 * 252  (0xFC) is max size for one USB or GBP paquet
-		 * 256 (0x100) maximum, 1 minimum
-		 */
-		text = "Case 2: CLA INS P1 P2 Le, L(Cmd) = 5";
-		end = 65535;
-		start = 1;
-
-		for (len_o = start; len_o <= end; len_o++)
-		{
-			char test_value = 0x42;
-
-#ifdef CONTACTLESS
-			s[0] = 0x00;
-			s[1] = 0xB0;
-			s[2] = 0x00;
-			s[3] = 0x00;
-#else
-			s[0] = 0x80;
-			s[1] = 0x00;
-			s[2] = 0x04;
-			s[3] = test_value;
-#endif
-			s[4] = 0x00;
-			s[5] = len_o >> 8;
-			s[6] = len_o;
-
-			dwSendLength = 7;
-			dwRecvLength = sizeof(r);
-
-			for (i=0; i<len_o; i++)
-				e[i] = test_value;
-			e[i++] = 0x90;
-			e[i++] = 0x00;
-			e_length = len_o+2;
-
-			if (exchange(text, SmartCardReader, 
-				s, dwSendLength, r, &dwRecvLength, e, e_length))
-				return 1;
-		}
-	}
+	return check_exchange(text, ctx, s, s_length, r, r_length,
+		e, NULL, e_length);
+}
 
-	return 0;
-} /* extended_apdu */
+/* exchange() with the expected response given by a generator */
+static int exchange_generated(const char *text, READER_CONTEXT *ctx,
+	unsigned char s[], unsigned int s_length,
+	unsigned char r[], UINTN * r_length,
+	CONST GENERATOR *g)
+{
+	return check_exchange(text, ctx, s, s_length, r, r_length,
+		NULL, g, g->length + 2);
+}
 
-int short_apdu(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
+int select_applet(READER_CONTEXT *ctx)
 {
-	int i, len_i, len_o;
-	unsigned char s[MAX_BUFFER_SIZE], r[MAX_BUFFER_SIZE];
+	unsigned char *s = ctx->s, *r = ctx->r;
 	UINTN dwSendLength, dwRecvLength;
-	unsigned char e[MAX_BUFFER_SIZE];	// expected result
+	unsigned char *e = ctx->e;	// expected result
 	int e_length;	// expected result length
 	const char *text = NULL;
-	int time;
-	int start, end;
 
 	/* Select applet */
 	text = "Select applet: ";
@@ -218,470 +432,1967 @@ int short_apdu(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
 	s[7] = 0x00;
 	s[8] = 0x00;
 	s[9] = 0x18;
-#ifdef COMBI
-	s[10] = 0x50;
-#else
-	s[10] = 0xFF;
-#endif
+	s[10] = combi ? 0x50 : 0xFF;
 
 	dwSendLength = 11;
-	dwRecvLength = sizeof(r);
+	dwRecvLength = MAX_BUFFER_SIZE;
 
 	e[0] = 0x90;
 	e[1] = 0x00;
 	e_length = 2;
 
-	if (exchange(text, SmartCardReader,
-		s, dwSendLength, r, &dwRecvLength, e, e_length))
+	if (exchange(text, ctx, s, dwSendLength, r, &dwRecvLength, e, e_length))
 		return 1;
 
-	/* Time Request */
-	if (timerequest >= 0)
+	SessionSetAid(&ctx->session, s + 5, s[4]);
+
+	return 0;
+} /* select_applet */
+
+/*
+ * Select the applet again after a warm reset of the card by the retry
+ * policy. ctx->s still contains the APDU to retry so local buffers are
+ * used.
+ */
+static EFI_STATUS reselect_applet(VOID *Context)
+{
+	READER_CONTEXT *ctx = Context;
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader = ctx->SmartCardReader;
+	unsigned char s[] = { 0x00, 0xA4, 0x04, 0x00, 0x06,
+		0xA0, 0x00, 0x00, 0x00, 0x18, 0xFF };
+	unsigned char r[2];
+	UINTN r_length = sizeof r;
+
+	if (combi)
+		s[10] = 0x50;
+
+	return SmartCardReader->SCardTransmit(SmartCardReader, s, sizeof s,
+		r, &r_length);
+}
+
+/* tests of the test applet, indexes of tests[] */
+enum
+{
+	SHORT_CASE1_APDU,
+	SHORT_CASE1_TPDU,
+	SHORT_CASE3,
+	SHORT_CASE2,
+	SHORT_CASE4_TPDU,
+	SHORT_CASE4_APDU,
+	EXTENDED_CASE3,
+	EXTENDED_CASE2,
+	GET_RESPONSE_CASE2,
+	CL_EXTENDED_CASE3,
+	CL_EXTENDED_CASE2,
+	CL_UPDATE_BINARY,
+	CL_READ_BINARY,
+};
+
+/* sweeps running a test */
+#define MODE_APDU 1		/**< short APDU, option 'a' */
+#define MODE_TPDU 2		/**< short TPDU, the default */
+#define MODE_EXTENDED 4	/**< extended APDU sweep, option 'e' */
+
+/* interface of the test applet */
+#define IF_CONTACT 1
+#define IF_CONTACTLESS 2	/**< option 'l' */
+#define IF_ANY (IF_CONTACT | IF_CONTACTLESS)
+
+/* Lc and command data */
+#define LC_NONE 0
+#define LC_SHORT 1		/**< Lc on 1 byte */
+#define LC_EXTENDED 2	/**< 00 then Lc on 2 bytes */
+
+#define DATA_NONE 0
+#define DATA_RAMP 1		/**< 00 01 02 ... */
+#define DATA_LENGTH 2	/**< the response length on 2 bytes */
+
+/* Le */
+#define LE_NONE 0
+#define LE_P3 1			/**< P3 = 00 of a Case 1 TPDU */
+#define LE_SHORT 2		/**< response length on 1 byte */
+#define LE_EXTENDED 3	/**< response length on 2 bytes, after 00 if no Lc */
+#define LE_MAX 4		/**< as LE_EXTENDED with 00 00 */
+
+/* the swept length is */
+#define SWEEP_NONE 0	/**< not used, a single command */
+#define SWEEP_IN 1		/**< the command data length */
+#define SWEEP_OUT 2		/**< the response data length */
+#define SWEEP_IN_OUT 3	/**< the command data length, response is 256 - it */
+
+/*
+ * A test sends one command for each length of [start, end]. The command
+ * is the header, then Lc, data and Le built from the length. The
+ * response data is given by a generator.
+ */
+typedef struct
+{
+	const char *phase;	/**< tests of the same phase are consecutive */
+	const char *text;
+	int test_case;		/**< CASE1 to CASE4, selected with cases */
+	UINT8 mode;			/**< MODE_APDU, MODE_TPDU and/or MODE_EXTENDED */
+	UINT8 interfaces;	/**< IF_CONTACT and/or IF_CONTACTLESS */
+	UINT8 header[4];	/**< CLA INS P1 P2 */
+	BOOLEAN p1p2;		/**< P1 P2 give the response length to the applet */
+	UINT8 lc;
+	UINT8 data;
+	UINT8 le;
+	UINT8 sweep;
+	int start, end;
+	/** 0x9000, or the status word before the response: 61xx then GET
+	 * RESPONSE. xx is the response length. */
+	UINT16 sw;
+	GENERATOR response;	/**< length set from the swept length */
+} TEST;
+
+#define NO_DATA { NULL, 0, 0 }
+#define RAMP { ramp_word, 0, 0 }
+
+/*
+ * Short lengths
+ * 248 (0xF8) Lc or 252 (0xFC) Le is max size for one USB or GBP paquet
+ * 255 (0xFF) Lc or 256 (0x100) Le maximum, 1 minimum
+ */
+static CONST TEST tests[] =
+{
+	[SHORT_CASE1_APDU] = { "Case 1", "Case 1, APDU: CLA INS P1 P2, L(Cmd) = 4",
+		CASE1, MODE_APDU, IF_ANY, { 0x80, 0x30, 0x00, 0x00 }, FALSE,
+		LC_NONE, DATA_NONE, LE_NONE, SWEEP_NONE, 0, 0, 0x9000, NO_DATA },
+	[SHORT_CASE1_TPDU] = { "Case 1", "Case 1, TPDU: CLA INS P1 P2 P3 (=0), L(Cmd) = 5",
+		CASE1, MODE_TPDU, IF_ANY, { 0x80, 0x30, 0x00, 0x00 }, FALSE,
+		LC_NONE, DATA_NONE, LE_P3, SWEEP_NONE, 0, 0, 0x9000, NO_DATA },
+	[SHORT_CASE3] = { "Case 3", "Case 3: CLA INS P1 P2 Lc Data, L(Cmd) = 5 + Lc",
+		CASE3, MODE_APDU | MODE_TPDU, IF_ANY, { 0x80, 0x32, 0x00, 0x00 }, FALSE,
+		LC_SHORT, DATA_RAMP, LE_NONE, SWEEP_IN, 1, 255, 0x9000, NO_DATA },
+	[SHORT_CASE2] = { "Case 2", "Case 2: CLA INS P1 P2 Le, L(Cmd) = 5",
+		CASE2, MODE_APDU | MODE_TPDU, IF_ANY, { 0x80, 0x34, 0x00, 0x00 }, TRUE,
+		LC_NONE, DATA_NONE, LE_SHORT, SWEEP_OUT, 1, 256, 0x9000, RAMP },
+	[SHORT_CASE4_TPDU] = { "Case 4", "Case 4, TPDU: CLA INS P1 P2 Lc Data, L(Cmd) = 5 + Lc",
+		CASE4, MODE_TPDU, IF_ANY, { 0x80, 0x36, 0x00, 0x00 }, TRUE,
+		LC_SHORT, DATA_RAMP, LE_NONE, SWEEP_IN_OUT, 1, 255, 0x6100, RAMP },
+	[SHORT_CASE4_APDU] = { "Case 4", "Case 4, APDU: CLA INS P1 P2 Lc Data Le, L(Cmd) = 5 + Lc +1",
+		CASE4, MODE_APDU, IF_ANY, { 0x80, 0x36, 0x00, 0x00 }, TRUE,
+		LC_SHORT, DATA_RAMP, LE_SHORT, SWEEP_IN_OUT, 1, 255, 0x9000, RAMP },
+	[EXTENDED_CASE3] = { "Extended Case 3", "Case 3: CLA INS P1 P2 Lc Data, L(Cmd) = 5 + Lc",
+		CASE3, MODE_EXTENDED, IF_CONTACT, { 0x80, 0x12, 0x01, 0x80 }, FALSE,
+		LC_EXTENDED, DATA_RAMP, LE_NONE, SWEEP_IN, 1, 65535, 0x9000, NO_DATA },
+	[EXTENDED_CASE2] = { "Extended Case 2", "Case 2: CLA INS P1 P2 Le, L(Cmd) = 5",
+		CASE2, MODE_EXTENDED, IF_CONTACT, { 0x80, 0x00, 0x04, 0x42 }, FALSE,
+		LC_NONE, DATA_NONE, LE_EXTENDED, SWEEP_OUT, 1, 65535, 0x9000,
+		{ constant_word, 0x42, 0 } },
+	/*
+	 * response as with EXTENDED_CASE2 but the card sends it 256 bytes at
+	 * a time, the rest with GET RESPONSE. Sent as a short Case 4 by
+	 * TransmitLarge() so only with the TRANSPORT_CHAINING transport.
+	 * INS 02 is only in the card of VirtualReader. Not in a sweep.
+	 */
+	[GET_RESPONSE_CASE2] = { "Get Response", "Case 2 by 61xx: CLA INS P1 P2 Lc Data Le, then GET RESPONSE",
+		CASE4, 0, IF_CONTACT, { 0x80, 0x02, 0x04, 0x42 }, FALSE,
+		LC_EXTENDED, DATA_LENGTH, LE_MAX, SWEEP_OUT, 1, 65535, 0x9000,
+		{ constant_word, 0x42, 0 } },
+	/*
+	 * UPDATE BINARY and READ BINARY at offset 0 of the current file. The
+	 * response is not checked: it is only the ramp after an UPDATE BINARY
+	 * of at least the same length.
+	 */
+	[CL_EXTENDED_CASE3] = { "Extended Case 3", "Case 3: CLA INS P1 P2 Lc Data, L(Cmd) = 5 + Lc",
+		CASE3, MODE_EXTENDED, IF_CONTACTLESS, { 0x00, 0xD6, 0x00, 0x00 }, FALSE,
+		LC_EXTENDED, DATA_RAMP, LE_NONE, SWEEP_IN, 1, 65535, 0x9000, NO_DATA },
+	[CL_EXTENDED_CASE2] = { "Extended Case 2", "Case 2: CLA INS P1 P2 Le, L(Cmd) = 5",
+		CASE2, MODE_EXTENDED, IF_CONTACTLESS, { 0x00, 0xB0, 0x00, 0x00 }, FALSE,
+		LC_NONE, DATA_NONE, LE_EXTENDED, SWEEP_OUT, 1, 65535, 0x9000, RAMP },
+	/* short forms, only for the READ/UPDATE BINARY benchmark */
+	[CL_UPDATE_BINARY] = { "Binary", "UPDATE BINARY: CLA INS P1 P2 Lc Data",
+		CASE3, 0, IF_CONTACTLESS, { 0x00, 0xD6, 0x00, 0x00 }, FALSE,
+		LC_SHORT, DATA_RAMP, LE_NONE, SWEEP_IN, 1, 255, 0x9000, NO_DATA },
+	[CL_READ_BINARY] = { "Binary", "READ BINARY: CLA INS P1 P2 Le",
+		CASE2, 0, IF_CONTACTLESS, { 0x00, 0xB0, 0x00, 0x00 }, FALSE,
+		LC_NONE, DATA_NONE, LE_SHORT, SWEEP_OUT, 1, 256, 0x9000, RAMP },
+};
+
+/* send the command of the test t for length and check the response */
+static int run_test(READER_CONTEXT *ctx, CONST TEST *t, int length)
+{
+	unsigned char *s = ctx->s, *r = ctx->r;
+	unsigned char *e = ctx->e;	// expected result
+	UINTN dwSendLength, dwRecvLength;
+	const char *text = t->text;
+	GENERATOR g = t->response;
+	int i, n, le;
+	int len_i = 0, len_o = 0;
+
+	switch (t->sweep)
 	{
-		text = "Time Request";
-		time = timerequest;
+		case SWEEP_IN:
+			len_i = length;
+			break;
+		case SWEEP_OUT:
+			len_o = length;
+			break;
+		case SWEEP_IN_OUT:
+			len_i = length;
+			len_o = 256 - length;
+			break;
+	}
 
-		s[0] = 0x80;
-		s[1] = 0x38;
+	CopyMem(s, t->header, 4);
+	if (t->p1p2)
+	{
+		/* 00 len_o or 01 len_o-256 */
+		s[2] = len_o >> 8;
+		s[3] = len_o;
+	}
+	dwSendLength = 4;
+
+	n = (DATA_LENGTH == t->data) ? 2 : len_i;
+	if (LC_SHORT == t->lc)
+		s[dwSendLength++] = n;
+	if (LC_EXTENDED == t->lc)
+	{
+		s[dwSendLength++] = 0x00;
+		s[dwSendLength++] = n >> 8;
+		s[dwSendLength++] = n;
+	}
+
+	if (DATA_RAMP == t->data)
+		for (i=0; i<len_i; i++)
+			s[dwSendLength++] = i;
+	if (DATA_LENGTH == t->data)
+	{
+		s[dwSendLength++] = len_o >> 8;
+		s[dwSendLength++] = len_o;
+	}
+
+	switch (t->le)
+	{
+		case LE_P3:
+			s[dwSendLength++] = 0x00;
+			break;
+		case LE_SHORT:
+			s[dwSendLength++] = len_o;
+			break;
+		case LE_EXTENDED:
+		case LE_MAX:
+			le = (LE_MAX == t->le) ? 0 : len_o;
+			if (LC_NONE == t->lc)
+				s[dwSendLength++] = 0x00;
+			s[dwSendLength++] = le >> 8;
+			s[dwSendLength++] = le;
+			break;
+	}
+
+	if ((LC_EXTENDED == t->lc) || (t->le >= LE_EXTENDED))
+		dwRecvLength = MAX_BUFFER_SIZE_EXTENDED;
+	else
+		dwRecvLength = MAX_BUFFER_SIZE;
+
+	if (0x9000 != t->sw)
+	{
+		e[0] = t->sw >> 8;
+		e[1] = (0x61 == e[0]) ? len_o : t->sw;
+
+		if (exchange(text, ctx,
+			s, dwSendLength, r, &dwRecvLength, e, 2))
+			return 1;
+
+		if (0x61 != e[0])
+			return 0;
+
+		/* Get response */
+		text = "Case 4, TPDU, Get response: ";
+		s[1] = 0xC0;
 		s[2] = 0x00;
-		s[3] = time;
-		s[4] = 0;
+		s[3] = 0x00;
+		s[4] = r[1]; /* SW2 of previous command */
 
-		if (apdu)
-			dwSendLength = 4;
-		else
-			dwSendLength = 5;
-		dwRecvLength = sizeof(r);
+		dwSendLength = 5;
+		dwRecvLength = MAX_BUFFER_SIZE;
+	}
+
+	g.length = len_o;
+
+	return exchange_generated(text, ctx,
+		s, dwSendLength, r, &dwRecvLength, &g);
+} /* run_test */
+
+/* extended APDU Case 3 with len_i bytes of data */
+int extended_case3(READER_CONTEXT *ctx, int len_i)
+{
+	return run_test(ctx,
+		&tests[contactless ? CL_EXTENDED_CASE3 : EXTENDED_CASE3], len_i);
+}
+
+/*
+ * The tests send the extended APDUs as they are. With 'X' they use the
+ * transport of the card in the session cache, see benchmark_transports().
+ */
+static void set_transport(READER_CONTEXT *ctx)
+{
+	ctx->transport = cached_transport ? ctx->session.entry.transport
+		: TRANSPORT_EXTENDED;
+}
+
+static const char *transport_name(UINTN transport)
+{
+	return (TRANSPORT_CHAINING == transport) ? "command chaining"
+		: "extended APDU";
+}
+
+/* extended APDU Case 2 with len_o bytes of response */
+int extended_case2(READER_CONTEXT *ctx, int len_o)
+{
+	return run_test(ctx,
+		&tests[contactless ? CL_EXTENDED_CASE2 : EXTENDED_CASE2], len_o);
+}
+
+/* INS 02 of GET_RESPONSE_CASE2 is not in the test applet of a real card */
+static BOOLEAN virtual_card(READER_CONTEXT *ctx)
+{
+	return 0 == StrnCmp(ctx->ReaderName, L"Virtual Reader", 14);
+}
+
+/* len_o bytes of response with GET RESPONSE, contact only */
+int get_response_case2(READER_CONTEXT *ctx, int len_o)
+{
+	return run_test(ctx, &tests[GET_RESPONSE_CASE2], len_o);
+}
+
+/* UPDATE BINARY of len_i bytes, extended above 255 */
+static int update_binary(READER_CONTEXT *ctx, int len_i)
+{
+	return run_test(ctx,
+		&tests[(len_i > 255) ? CL_EXTENDED_CASE3 : CL_UPDATE_BINARY], len_i);
+}
+
+/* READ BINARY of len_o bytes, extended above 256 */
+static int read_binary(READER_CONTEXT *ctx, int len_o)
+{
+	return run_test(ctx,
+		&tests[(len_o > 256) ? CL_EXTENDED_CASE2 : CL_READ_BINARY], len_o);
+}
+
+/* short APDU Case 3 with len_i bytes of data */
+int short_case3(READER_CONTEXT *ctx, int len_i)
+{
+	return run_test(ctx, &tests[SHORT_CASE3], len_i);
+}
+
+/* short APDU Case 2 with len_o bytes of response */
+int short_case2(READER_CONTEXT *ctx, int len_o)
+{
+	return run_test(ctx, &tests[SHORT_CASE2], len_o);
+}
+
+/*
+ * The checkpoints are stored in the non volatile variable
+ * "CheckpointN" where N is the reader number.
+ */
+static void CheckpointName(READER_CONTEXT *ctx, CHAR16 *Name, UINTN Size)
+{
+	UnicodeSPrint(Name, Size, L"Checkpoint%d", ctx->index);
+}
+
+static void SaveCheckpoint(READER_CONTEXT *ctx, UINT32 test_case,
+	UINT32 length)
+{
+	CHECKPOINT cp;
+	CHAR16 Name[32];
+	EFI_STATUS Status;
+
+	ZeroMem(&cp, sizeof cp);
+	cp.version = CHECKPOINT_VERSION;
+	cp.test_case = test_case;
+	cp.length = length;
+	cp.exchanges = ctx->exchanges;
+	CopyMem(cp.ReaderName, ctx->ReaderName, sizeof cp.ReaderName);
+
+	CheckpointName(ctx, Name, sizeof Name);
+	Status = gRT->SetVariable(Name, &CheckpointGuid,
+		EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+		sizeof cp, &cp);
+	if (EFI_ERROR(Status))
+		Print(L"ERROR: SetVariable: %d\n", Status);
+}
+
+/* called before testing a length: re-arm the watchdog and checkpoint */
+static void Progress(READER_CONTEXT *ctx, UINT32 test_case, UINT32 length)
+{
+	UINT64 now = StopwatchNow();
+
+	gBS->SetWatchdogTimer(WATCHDOG_TIMEOUT, 0, 0, NULL);
+
+	if (StopwatchTicksToNs(StopwatchElapsed(ctx->checkpoint_time, now))
+		>= MultU64x32(CHECKPOINT_SECONDS, 1000000000))
+	{
+		SaveCheckpoint(ctx, test_case, length);
+		ctx->checkpoint_time = now;
+	}
+}
+
+static int LoadCheckpoint(READER_CONTEXT *ctx, CHECKPOINT *cp)
+{
+	CHAR16 Name[32];
+	UINTN Size = sizeof *cp;
+	EFI_STATUS Status;
+
+	CheckpointName(ctx, Name, sizeof Name);
+	Status = gRT->GetVariable(Name, &CheckpointGuid, NULL, &Size, cp);
+	if (EFI_ERROR(Status) || (Size != sizeof *cp)
+		|| (cp->version != CHECKPOINT_VERSION))
+		return 0;
+
+	/* the checkpoint is for another reader */
+	if (StrCmp(cp->ReaderName, ctx->ReaderName))
+	{
+		Print(L"Checkpoint for %s ignored\n", cp->ReaderName);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void DeleteCheckpoint(READER_CONTEXT *ctx)
+{
+	CHAR16 Name[32];
+
+	CheckpointName(ctx, Name, sizeof Name);
+	gRT->SetVariable(Name, &CheckpointGuid, 0, 0, NULL);
+}
+
+/*
+ * Sampled sweep: a length is tested if the CCID message carrying it is
+ * near a USB packet boundary or a dwMaxCCIDMessageLength boundary, if
+ * the length is near a multiple of 256, or if it is randomly selected.
+ * overhead is the number of bytes added to the length in the APDU.
+ */
+static int is_boundary(UINT32 length, UINT32 overhead, UINT32 max_message)
+{
+	UINT32 apdu = length + overhead;
+	UINT32 message = CCID_HEADER_SIZE + apdu;
+
+	if ((length <= 2) || (length >= 65533))
+		return TRUE;
+
+	/* near a USB packet boundary */
+	if (((message + 1) % USB_PACKET_SIZE) <= 2)
+		return TRUE;
+
+	/* near a multiple of the maximum CCID message */
+	if (max_message && (((message + 1) % max_message) <= 2))
+		return TRUE;
+
+	/* near a multiple of 256 */
+	if (((length + 1) % 256) <= 2)
+		return TRUE;
+
+	return FALSE;
+}
+
+/* stateless and reproducible: the same seed gives the same lengths */
+static int is_sampled(UINT32 test_case, UINT32 length)
+{
+	UINT32 h = seed ^ (test_case << 16) ^ length;
+
+	/* integer hash from MurmurHash3 finalizer */
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return (h % SAMPLE_RATE) == 0;
+}
+
+/* return TRUE if the length must be tested */
+static int select_length(READER_CONTEXT *ctx, UINT32 test_case,
+	UINT32 length, UINT32 max_message)
+{
+	int i = (test_case == CASE3) ? 0 : 1;
+	/* Case 3: CLA INS P1 P2 00 Lc1 Lc2, Case 2: SW1 SW2 */
+	UINT32 overhead = (test_case == CASE3) ? 7 : 2;
+
+	if (!sampled)
+		return TRUE;
+
+	if (is_boundary(length, overhead, max_message))
+	{
+		ctx->boundary[i]++;
+		return TRUE;
+	}
+
+	if (is_sampled(test_case, length))
+	{
+		ctx->random[i]++;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* dwMaxCCIDMessageLength of the reader or 0 if unknown */
+static UINT32 max_message_length(READER_CONTEXT *ctx)
+{
+	EFI_STATUS Status;
+	UINT32 MaxInput = 0;
+	UINTN Length = sizeof MaxInput;
+
+	/* the CCID driver returns dwMaxCCIDMessageLength -10 */
+	Status = ctx->SmartCardReader->SCardGetAttrib(ctx->SmartCardReader,
+		SCARD_ATTR_MAXINPUT, (UINT8 *)&MaxInput, &Length);
+	if (EFI_ERROR(Status) || (Length != sizeof MaxInput) || (0 == MaxInput))
+		return 0;
+
+	return MaxInput + CCID_HEADER_SIZE;
+}
+
+/* TRUE if the test t is selected by modes, cases and the interface */
+static BOOLEAN selected(CONST TEST *t, UINT8 modes)
+{
+	UINT8 interface = contactless ? IF_CONTACTLESS : IF_CONTACT;
+
+	return (t->mode & modes) && (t->test_case & cases)
+		&& (t->interfaces & interface);
+}
+
+/*
+ * Run the tests of tests[] selected by modes and cases, in the table
+ * order. The extended sweep is sampled, see select_length(), saves a
+ * checkpoint if checkpoint is set and starts from cp if not NULL.
+ */
+static int run_tests(READER_CONTEXT *ctx, UINT8 modes, int checkpoint,
+	CONST CHECKPOINT *cp, UINT32 max_message)
+{
+	CONST TEST *t;
+	const char *last = NULL;
+	int length, start;
+
+	/* a checkpoint of a Case that is not selected would skip all */
+	if (cp)
+	{
+		for (t = tests; t < tests + ARRAY_SIZE(tests); t++)
+			if (selected(t, modes) && (t->test_case == cp->test_case))
+				break;
+
+		if (t == tests + ARRAY_SIZE(tests))
+		{
+			Print(L"Checkpoint of a Case not selected: start from the beginning\n");
+			cp = NULL;
+		}
+	}
+
+	for (t = tests; t < tests + ARRAY_SIZE(tests); t++)
+	{
+		if (!selected(t, modes))
+			continue;
+
+		start = t->start;
+		if (cp)
+		{
+			/* skip the tests before the checkpoint */
+			if (t->test_case != cp->test_case)
+				continue;
+			start = cp->length;
+			cp = NULL;
+		}
+
+		if (!last || AsciiStrCmp(last, t->phase))
+			phase(ctx, t->phase);
+		last = t->phase;
+
+		for (length = start; length <= t->end; length++)
+		{
+			int rv;
+
+			if (t->mode & MODE_EXTENDED)
+			{
+				if (checkpoint)
+					Progress(ctx, t->test_case, length);
+
+				if (!select_length(ctx, t->test_case, length, max_message))
+					continue;
+			}
+
+			/* only the APDUs of the test are measured, not the SELECT or
+			 * the recovery around it */
+			ctx->measured_case = HighBitSet32(t->test_case) + 1;
+			rv = run_test(ctx, t, length);
+			ctx->measured_case = 0;
+			if (rv)
+				return 1;
+		}
+	}
+
+	return 0;
+} /* run_tests */
+
+/*
+ * Checkpoints use boot and runtime services so they are only used when
+ * the readers are tested one after the other on the BSP.
+ */
+int extended_apdu(READER_CONTEXT *ctx)
+{
+	int checkpoint = !parallel;
+	CHECKPOINT cp;
+	CHECKPOINT *from = NULL;
+	UINT32 max_message = 0;
+
+	if (sampled)
+	{
+		max_message = max_message_length(ctx);
+		LOG(ctx, L"dwMaxCCIDMessageLength: %d\n", max_message);
+	}
+
+	ctx->checkpoint_time = StopwatchNow();
+	if (checkpoint && resume && LoadCheckpoint(ctx, &cp))
+	{
+		Print(L"Resume Case %d at length %d\n",
+			cp.test_case == CASE3 ? 3 : 2, cp.length);
+		from = &cp;
+		ctx->exchanges += cp.exchanges;
+	}
+
+	if (run_tests(ctx, MODE_EXTENDED, checkpoint, from, max_message))
+	{
+		/* keep the last checkpoint so the sweep can be resumed */
+		if (checkpoint)
+			gBS->SetWatchdogTimer(0, 0, 0, NULL);
+
+		return 1;
+	}
+
+	if (checkpoint)
+	{
+		DeleteCheckpoint(ctx);
+		gBS->SetWatchdogTimer(0, 0, 0, NULL);
+	}
+
+	return 0;
+} /* extended_apdu */
+
+/*
+ * Case 1 to 4 with the short APDUs. In benchmark mode, exchange()
+ * measures the Case in ctx->measured_case.
+ */
+int short_apdu(READER_CONTEXT *ctx)
+{
+	unsigned char *s = ctx->s, *r = ctx->r;
+	UINTN dwSendLength, dwRecvLength;
+	unsigned char *e = ctx->e;	// expected result
+	int e_length;	// expected result length
+	const char *text = NULL;
+	int time;
+	UINT8 modes = 0;
+
+	phase(ctx, "Select");
+	if (select_applet(ctx))
+		return 1;
+
+	/* Time Request */
+	if (timerequest >= 0)
+	{
+		phase(ctx, "Time Request");
+		text = "Time Request";
+		time = timerequest;
+
+		s[0] = 0x80;
+		s[1] = 0x38;
+		s[2] = 0x00;
+		s[3] = time;
+		s[4] = 0;
+
+		if (apdu)
+			dwSendLength = 4;
+		else
+			dwSendLength = 5;
+		dwRecvLength = MAX_BUFFER_SIZE;
+
+		e[0] = 0x90;
+		e[1] = 0x00;
+		e_length = 2;
+
+		if (exchange(text, ctx,
+			s, dwSendLength, r, &dwRecvLength, e, e_length))
+			return 1;
+	}
+
+	if (apdu)
+		modes |= MODE_APDU;
+	if (tpdu)
+		modes |= MODE_TPDU;
+
+	return run_tests(ctx, modes, FALSE, NULL, 0);
+} /* short_apdu */
+
+typedef int (*LENGTH_TEST)(READER_CONTEXT *ctx, int length);
+
+/*
+ * Reset the card after a failed probe so the next length starts from a
+ * clean state.
+ */
+static void recover(READER_CONTEXT *ctx)
+{
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader = ctx->SmartCardReader;
+	UINT32 ActiveProtocol;
+	int result = ctx->result;
+
+	SmartCardReader->SCardDisconnect(SmartCardReader, SCARD_CA_COLDRESET);
+	SessionConnect(SmartCardReader, SCARD_CA_COLDRESET, &ctx->session,
+		&ActiveProtocol);
+	set_transport(ctx);
+	select_applet(ctx);
+
+	/* a probe failure is not a reader failure */
+	ctx->result = result;
+}
+
+/* test one length without recording a failure of the reader */
+static int try_length(READER_CONTEXT *ctx, LENGTH_TEST test, int length)
+{
+	int result = ctx->result;
+
+	if (0 == test(ctx, length))
+		return 0;
+
+	ctx->result = result;
+	recover(ctx);
+
+	return 1;
+}
+
+/*
+ * Find the biggest working length in [1, max] with an exponential
+ * search followed by a bisection. Return 0 if length 1 does not work.
+ */
+static int probe_max(READER_CONTEXT *ctx, LENGTH_TEST test, int max)
+{
+	int good = 0, bad = max + 1, len = 1;
+
+	/* exponential search */
+	while (len <= max)
+	{
+		if (try_length(ctx, test, len))
+		{
+			bad = len;
+			break;
+		}
+		good = len;
+		if (len == max)
+			break;
+		len = (2*len > max) ? max : 2*len;
+	}
+
+	/* bisection in ]good, bad[ */
+	while (bad - good > 1)
+	{
+		len = good + (bad - good) / 2;
+		if (try_length(ctx, test, len))
+			bad = len;
+		else
+			good = len;
+	}
+
+	return good;
+}
+
+static void add_length(int lengths[], int *nb, int max_nb, int length,
+	int max)
+{
+	int i, j;
+
+	if ((length < 1) || (length > max))
+		return;
+
+	/* keep the list sorted and without duplicates */
+	for (i=0; i<*nb && lengths[i]<length; i++)
+		;
+	if ((i < *nb) && (lengths[i] == length))
+		return;
+	if (*nb >= max_nb)
+		return;
+	for (j=*nb; j>i; j--)
+		lengths[j] = lengths[j-1];
+	lengths[i] = length;
+	(*nb)++;
+}
+
+/*
+ * Check the lengths around the packet boundaries up to max:
+ * - the historical GBP and USB limits 248, 252 and 261
+ * - the short APDU limits 255 and 256
+ * - the CCID bulk message (10 bytes header + overhead bytes added to the
+ *   length in the APDU) split in 64 bytes USB packets, up to 1 kB
+ * - the powers of 2
+ * - max itself
+ */
+static int check_boundaries(READER_CONTEXT *ctx, LENGTH_TEST test, int max,
+	int overhead)
+{
+	static const int fixed[] = { 248, 252, 255, 256, 261 };
+	int lengths[200];
+	int nb = 0, i, b;
+
+	for (i=0; i<ARRAY_SIZE(fixed); i++)
+		for (b=-1; b<=1; b++)
+			add_length(lengths, &nb, ARRAY_SIZE(lengths), fixed[i]+b, max);
+
+	for (i=64; i<=1024; i+=64)
+		for (b=-1; b<=1; b++)
+			add_length(lengths, &nb, ARRAY_SIZE(lengths),
+				i - CCID_HEADER_SIZE - overhead + b, max);
+
+	for (i=1; i<=max; i*=2)
+		for (b=-1; b<=1; b++)
+			add_length(lengths, &nb, ARRAY_SIZE(lengths), i+b, max);
+
+	add_length(lengths, &nb, ARRAY_SIZE(lengths), max, max);
+
+	for (i=0; i<nb; i++)
+		if (test(ctx, lengths[i]))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Check the maximum length found for this card the last time: it must
+ * work and the next length must fail. Two APDUs instead of a search.
+ */
+static BOOLEAN check_max(READER_CONTEXT *ctx, LENGTH_TEST test, int max,
+	int cached)
+{
+	if ((cached < 0) || (cached > max))
+		return FALSE;
+
+	if (cached && try_length(ctx, test, cached))
+		return FALSE;
+
+	return (cached == max) || try_length(ctx, test, cached + 1);
+}
+
+/*
+ * Capability probe: find the maximum Lc and Le for short and extended
+ * APDUs, then check only the lengths around the packet boundaries. The
+ * maximums of the session cache are checked before searching.
+ */
+int probe_lengths(READER_CONTEXT *ctx)
+{
+	static const struct
+	{
+		LENGTH_TEST test;
+		int max;
+		int overhead;	/**< bytes added to the length, see is_boundary() */
+	} probes[] = {
+		{ short_case3, 255, 5 },		/* CLA INS P1 P2 Lc */
+		{ short_case2, 256, 2 },		/* SW1 SW2 */
+		{ extended_case3, 65535, 7 },	/* CLA INS P1 P2 00 Lc1 Lc2 */
+		{ extended_case2, 65535, 2 },	/* SW1 SW2 */
+	};
+	int i;
+
+	if (select_applet(ctx))
+		return 1;
+
+	for (i=0; i<ARRAY_SIZE(probes); i++)
+	{
+		int max;
+
+		/* index 0 and 2 are Case 3, 1 and 3 are Case 2 */
+		if (!(cases & ((i % 2) ? CASE2 : CASE3)))
+			continue;
+
+		max = ctx->session.entry.max_length[i];
+		if (!ctx->session.cached
+			|| !check_max(ctx, probes[i].test, probes[i].max, max))
+			max = probe_max(ctx, probes[i].test, probes[i].max);
+		ctx->max_length[i] = max;
+		ctx->session.entry.max_length[i] = max;
+		if (max && check_boundaries(ctx, probes[i].test, max,
+				probes[i].overhead))
+			return 1;
+	}
+
+	return 0;
+} /* probe_lengths */
+
+/*
+ * Benchmark: the same short APDU workload with T=0 then T=1, each in
+ * its own connection. The faster protocol becomes the protocol of the
+ * card in the session cache.
+ */
+static void benchmark_protocols(READER_CONTEXT *ctx)
+{
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader = ctx->SmartCardReader;
+	static const UINT32 protocols[2] = { SCARD_PROTOCOL_T0, SCARD_PROTOCOL_T1 };
+	static const char *names[2] = { "Benchmark T=0", "Benchmark T=1" };
+	UINT64 total_ns[2] = { 0, 0 };
+	UINT32 ActiveProtocol;
+	EFI_STATUS Status;
+	int p, c;
+
+	for (p=0; p<2; p++)
+	{
+		BENCH *b = &ctx->bench[p];
+
+		ZeroMem(b, sizeof *b);
+		for (c=0; c<4; c++)
+			HistogramReset(&b->latency[c]);
+
+		phase(ctx, names[p]);
+		SmartCardReader->SCardDisconnect(SmartCardReader, SCARD_CA_COLDRESET);
+		Status = SmartCardReader->SCardConnect(SmartCardReader,
+			SCARD_AM_CARD, SCARD_CA_COLDRESET, protocols[p], &ActiveProtocol);
+		if (EFI_ERROR(Status) || (ActiveProtocol != protocols[p]))
+		{
+			LOG(ctx, L"T=%d not supported by the card: %d\n", p, Status);
+			continue;
+		}
+		b->done = TRUE;
+
+		ctx->measured = b;
+		b->result = short_apdu(ctx);
+		ctx->measured = NULL;
+		ctx->measured_case = 0;
+
+		for (c=0; c<4; c++)
+			total_ns[p] += b->latency[c].total_ns;
+	}
+
+	/* leave the card connected for SCardDisconnect() */
+	if (!ctx->bench[1].done)
+	{
+		SmartCardReader->SCardDisconnect(SmartCardReader, SCARD_CA_COLDRESET);
+		SessionConnect(SmartCardReader, SCARD_CA_COLDRESET, &ctx->session,
+			&ActiveProtocol);
+	}
+
+	/* same workload: compare the total time */
+	if (ctx->bench[0].done && ctx->bench[1].done
+		&& (0 == ctx->bench[0].result) && (0 == ctx->bench[1].result)
+		&& (ctx->session.entry.AtrLength))
+	{
+		p = (total_ns[1] < total_ns[0]) ? 1 : 0;
+		if (ctx->session.entry.protocol != protocols[p])
+		{
+			ctx->session.entry.protocol = protocols[p];
+			ctx->session.entry.IFSC = 0;
+		}
+	}
+}
+
+/* run a transfer without recording a failure of the reader, 0 if failed */
+static UINT64 time_transfer(READER_CONTEXT *ctx, LENGTH_TEST test,
+	UINTN transport, int length)
+{
+	STOPWATCH sw;
+	UINT64 ns;
+	UINTN previous = ctx->transport;
+
+	ctx->transport = transport;
+	StopwatchStart(&sw);
+	if (try_length(ctx, test, length))
+		ns = 0;
+	else
+		ns = StopwatchStop(&sw);
+	ctx->transport = previous;
+
+	return ns;
+}
+
+/*
+ * Benchmark: send (Case 3) and receive (Case 2) the same payloads with
+ * extended APDUs and with command chaining and GET RESPONSE. The
+ * transport with the lower total time for the sizes both could transfer
+ * becomes the transport of the card in the session cache. The receive
+ * with GET RESPONSE needs INS 02 so is only timed with VirtualReader.
+ */
+static void benchmark_transports(READER_CONTEXT *ctx)
+{
+	UINT64 total[2] = { 0, 0 };
+	UINTN i, t;
+
+	phase(ctx, "Transports");
+	if (select_applet(ctx))
+		return;
+
+	for (i=0; i<TRANSPORT_SIZES; i++)
+	{
+		UINT64 (*ns)[2] = ctx->transport_ns[i];
+
+		ns[0][TRANSPORT_EXTENDED] = time_transfer(ctx, extended_case3,
+			TRANSPORT_EXTENDED, transport_sizes[i]);
+		ns[0][TRANSPORT_CHAINING] = time_transfer(ctx, extended_case3,
+			TRANSPORT_CHAINING, transport_sizes[i]);
+		ns[1][TRANSPORT_EXTENDED] = time_transfer(ctx, extended_case2,
+			TRANSPORT_EXTENDED, transport_sizes[i]);
+		if (!contactless && virtual_card(ctx))
+			ns[1][TRANSPORT_CHAINING] = time_transfer(ctx, get_response_case2,
+				TRANSPORT_CHAINING, transport_sizes[i]);
+
+		for (t=0; t<2; t++)
+			if (ns[t][TRANSPORT_EXTENDED] && ns[t][TRANSPORT_CHAINING])
+			{
+				total[TRANSPORT_EXTENDED] += ns[t][TRANSPORT_EXTENDED];
+				total[TRANSPORT_CHAINING] += ns[t][TRANSPORT_CHAINING];
+			}
+	}
+
+	if (total[TRANSPORT_EXTENDED] || total[TRANSPORT_CHAINING])
+		ctx->session.entry.transport =
+			(total[TRANSPORT_CHAINING] < total[TRANSPORT_EXTENDED]) ?
+			TRANSPORT_CHAINING : TRANSPORT_EXTENDED;
+}
+
+/*
+ * Contactless benchmark: UPDATE BINARY then READ BINARY of increasing
+ * sizes, as short APDUs up to 255 bytes and as extended APDUs above.
+ * After a failed size the larger ones are not tried.
+ */
+static void benchmark_binary(READER_CONTEXT *ctx)
+{
+	static CONST LENGTH_TEST commands[2] = { update_binary, read_binary };
+	BOOLEAN failed[2] = { FALSE, FALSE };
+	STOPWATCH sw;
+	UINT64 ns;
+	UINTN i, d, n;
+
+	phase(ctx, "Binary");
+	if (select_applet(ctx))
+		return;
+
+	for (i=0; i<BINARY_SIZES; i++)
+		for (d=0; d<2; d++)
+		{
+			if (failed[d])
+				continue;
+
+			ns = 0;
+			for (n=0; n<BINARY_ROUNDS; n++)
+			{
+				StopwatchStart(&sw);
+				if (try_length(ctx, commands[d], binary_sizes[i]))
+				{
+					failed[d] = TRUE;
+					break;
+				}
+				ns += StopwatchStop(&sw);
+			}
+
+			if (!failed[d])
+				ctx->binary_ns[i][d] = DivU64x32(ns, BINARY_ROUNDS);
+		}
+}
+
+/*
+ * Report mode: run the short APDU workload REPORT_ROUNDS times. After a
+ * failed run the card is reset and the next run starts.
+ */
+static void report_workload(READER_CONTEXT *ctx)
+{
+	BENCH *b = &ctx->report;
+	STOPWATCH sw;
+	int c, n;
+
+	ZeroMem(b, sizeof *b);
+	for (c=0; c<4; c++)
+		HistogramReset(&b->latency[c]);
+	b->done = TRUE;
+
+	ctx->measured = b;
+	for (n=0; n<REPORT_ROUNDS; n++)
+	{
+		ctx->measured_case = 0;
+		StopwatchStart(&sw);
+		b->result = short_apdu(ctx);
+		ctx->report_ns += StopwatchStop(&sw);
+
+		if (b->result)
+		{
+			ctx->report_failed++;
+			recover(ctx);
+		}
+	}
+	ctx->measured = NULL;
+	ctx->measured_case = 0;
+}
+
+int CheckReader(READER_CONTEXT *ctx)
+{
+	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader = ctx->SmartCardReader;
+	EFI_STATUS  Status;
+	UINTN ReaderNameLength = sizeof ctx->ReaderName;
+	UINT32 State;
+	UINT32 CardProtocol;
+	UINT8 Atr[33];
+	UINTN AtrLength = sizeof Atr;
+	UINT32 ActiveProtocol;
+	int i;
+
+	/*
+	 * SCardStatus
+	 */
+	phase(ctx, "Connect");
+	Status = SmartCardReader->SCardStatus(SmartCardReader,
+			ctx->ReaderName,
+			&ReaderNameLength,
+			&State,
+			&CardProtocol,
+			Atr,
+			&AtrLength);
+	if (EFI_ERROR(Status))
+	{
+		LOG(ctx, L"ERROR: SCardStatus: %d\n", Status);
+		phase(ctx, NULL);
+		return failure(ctx, "SCardStatus", 0, 0, Status);
+	}
+
+	LOG(ctx, L"ReaderName (%d): %s\n", ReaderNameLength, ctx->ReaderName);
+	LOG(ctx, L"State: %d: ", State);
+	switch(State)
+	{
+		case SCARD_UNKNOWN:
+			LOG(ctx, L"SCARD_UNKNOWN");
+			break;
+		case SCARD_ABSENT:
+			LOG(ctx, L"SCARD_ABSENT");
+			break;
+		case SCARD_INACTIVE:
+			LOG(ctx, L"SCARD_INACTIVE");
+			break;
+		case SCARD_ACTIVE:
+			LOG(ctx, L"SCARD_ACTIVE");
+			break;
+	}
+	LOG(ctx, L"\n");
+	LOG(ctx, L"CardProtocol: %d\n", CardProtocol);
+	LOG(ctx, L"Atr (%d): ", AtrLength);
+	for (i=0; i<AtrLength; i++)
+		LOG(ctx, L"%02X ", Atr[i]);
+	LOG(ctx, L"\n");
+
+	/* the cache is only read here, so from several APs at once */
+	SessionLookup(fresh_session ? NULL : &session_cache, Atr, AtrLength,
+		&ctx->session);
+
+	/*
+	 * SCardConnect, with the protocol of the last time if the card is
+	 * known
+	 */
+	Status = SessionConnect(SmartCardReader, SCARD_CA_COLDRESET,
+		&ctx->session, &ActiveProtocol);
+	if (EFI_ERROR(Status))
+	{
+		LOG(ctx, L"ERROR: SCardConnect: %d\n", Status);
+		phase(ctx, NULL);
+		return failure(ctx, "SCardConnect", 0, 0, Status);
+	}
+
+	set_transport(ctx);
+	LOG(ctx, L"transport: %a\n", transport_name(ctx->transport));
+
+	if (report)
+		report_workload(ctx);
+	else
+	if (benchmark)
+		benchmark_protocols(ctx);
+	else
+	if (binary)
+		benchmark_binary(ctx);
+	else
+	if (transports)
+		benchmark_transports(ctx);
+	else
+	if (probe)
+	{
+		phase(ctx, "Probe");
+		probe_lengths(ctx);
+	}
+	else
+		if (extended)
+			extended_apdu(ctx);
+		else
+			short_apdu(ctx);
+
+	/*
+	 * SCardDisconnect
+	 */
+	phase(ctx, "Disconnect");
+	Status = SmartCardReader->SCardDisconnect(SmartCardReader,
+		SCARD_CA_NORESET);
+	phase(ctx, NULL);
+	if (EFI_ERROR(Status))
+	{
+		LOG(ctx, L"ERROR: SCardDisconnect: %d\n", Status);
+		return failure(ctx, "SCardDisconnect", 0, 0, Status);
+	}
+
+	return ctx->result;
+}
+
+static void FreeBuffers(READER_CONTEXT *ctx)
+{
+	if (ctx->s)
+		FreePool(ctx->s);
+	if (ctx->r)
+		FreePool(ctx->r);
+	if (ctx->e)
+		FreePool(ctx->e);
+	ctx->s = ctx->r = ctx->e = NULL;
+}
+
+static void FreeContext(READER_CONTEXT *ctx)
+{
+	FreeBuffers(ctx);
+	FreePool(ctx);
+}
+
+static READER_CONTEXT *NewContext(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader,
+	UINTN index)
+{
+	READER_CONTEXT *ctx;
+
+	ctx = AllocateZeroPool(sizeof *ctx);
+	if (NULL == ctx)
+		return NULL;
+
+	ctx->SmartCardReader = SmartCardReader;
+	ctx->index = index;
+	ctx->retry = retry_policy;
+	ctx->retry.Reconnected = reselect_applet;
+	ctx->retry.Context = ctx;
+
+	/* too big for the stack of an AP */
+	ctx->s = AllocatePool(MAX_BUFFER_SIZE_EXTENDED);
+	ctx->r = AllocatePool(MAX_BUFFER_SIZE_EXTENDED);
+	ctx->e = AllocatePool(MAX_BUFFER_SIZE_EXTENDED);
+	if ((NULL == ctx->s) || (NULL == ctx->r) || (NULL == ctx->e))
+	{
+		FreeContext(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+static VOID EFIAPI CheckReaderOnAP(IN OUT VOID *Buffer)
+{
+	CheckReader((READER_CONTEXT *)Buffer);
+}
+
+/*
+ * Run Procedure for each reader on its own application processor.
+ * The reader driver must be MP safe: no boot services and no console
+ * output in SCardStatus/SCardConnect/SCardTransmit/SCardDisconnect.
+ * The readers that do not get an AP are handled by the BSP.
+ */
+static void RunParallel(READER_CONTEXT *ctx[], UINTN nb_readers,
+	EFI_AP_PROCEDURE Procedure)
+{
+	EFI_STATUS Status;
+	EFI_MP_SERVICES_PROTOCOL *MpServices;
+	UINTN NumberOfProcessors = 0, NumberOfEnabledProcessors, Bsp = 0;
+	UINTN cpu, next = 0, i, Index;
+	EFI_EVENT *Events;
+
+	Events = AllocateZeroPool(nb_readers * sizeof *Events);
+	if (NULL == Events)
+		return;
+
+	Status = gBS->LocateProtocol(&gEfiMpServiceProtocolGuid, NULL,
+		(VOID **)&MpServices);
+	if (EFI_ERROR(Status))
+		Print(L"No EFI_MP_SERVICES_PROTOCOL: %d\n", Status);
+	else
+	{
+		MpServices->GetNumberOfProcessors(MpServices, &NumberOfProcessors,
+			&NumberOfEnabledProcessors);
+		MpServices->WhoAmI(MpServices, &Bsp);
+	}
+
+	for (cpu = 0; (cpu < NumberOfProcessors) && (next < nb_readers); cpu++)
+	{
+		EFI_PROCESSOR_INFORMATION Info;
+
+		if (cpu == Bsp)
+			continue;
+
+		Status = MpServices->GetProcessorInfo(MpServices, cpu, &Info);
+		if (EFI_ERROR(Status) || !(Info.StatusFlag & PROCESSOR_ENABLED_BIT))
+			continue;
+
+		Status = gBS->CreateEvent(0, 0, NULL, NULL, &Events[next]);
+		if (EFI_ERROR(Status))
+			break;
+
+		ctx[next]->quiet = TRUE;
+		Status = MpServices->StartupThisAP(MpServices, Procedure, cpu,
+			Events[next], 0, ctx[next], NULL);
+		if (EFI_ERROR(Status))
+		{
+			gBS->CloseEvent(Events[next]);
+			Events[next] = NULL;
+			continue;
+		}
+
+		Print(L"reader %d: CPU %d\n", ctx[next]->index, cpu);
+		next++;
+	}
+
+	/* no AP left */
+	for (i = next; i < nb_readers; i++)
+	{
+		Print(L"reader %d: BSP\n", ctx[i]->index);
+		ctx[i]->quiet = TRUE;
+		Procedure(ctx[i]);
+	}
+
+	for (i = 0; i < next; i++)
+	{
+		gBS->WaitForEvent(1, &Events[i], &Index);
+		gBS->CloseEvent(Events[i]);
+	}
+
+	FreePool(Events);
+}
+
+/* pop the next length to test, stealing from another shard if needed */
+static int NextSweepItem(READER_CONTEXT *ctx, UINT32 *item)
+{
+	SHARD *own = &sweep.shards[ctx->shard];
+	SHARD *victim = NULL;
+	UINT32 remaining = 0, half;
+	UINTN i;
+	int ret = 0;
+
+	AcquireSpinLock(&sweep.lock);
+
+	if (own->next >= own->end)
+	{
+		/* steal the upper half of the biggest shard */
+		for (i=0; i<sweep.nb_shards; i++)
+			if (sweep.shards[i].end - sweep.shards[i].next > remaining)
+			{
+				victim = &sweep.shards[i];
+				remaining = victim->end - victim->next;
+			}
+
+		if (victim)
+		{
+			half = (remaining + 1) / 2;
+			own->end = victim->end;
+			own->next = victim->end - half;
+			victim->end = own->next;
+			ctx->steals++;
+		}
+	}
+
+	if (own->next < own->end)
+	{
+		*item = own->next++;
+		ret = 1;
+	}
+
+	ReleaseSpinLock(&sweep.lock);
+
+	return ret;
+}
+
+static VOID EFIAPI SweepOnAP(IN OUT VOID *Buffer)
+{
+	READER_CONTEXT *ctx = Buffer;
+	UINT32 item;
+
+	while (NextSweepItem(ctx, &item))
+	{
+		if (item < sweep.nb_case3)
+		{
+			if (extended_case3(ctx, item + 1))
+				break;
+			ctx->lengths[0]++;
+		}
+		else
+		{
+			if (extended_case2(ctx, item - sweep.nb_case3 + 1))
+				break;
+			ctx->lengths[1]++;
+		}
+	}
+}
+
+/*
+ * Split the extended APDU length sweep between all the readers with
+ * the test applet. Each reader starts with a contiguous shard of the
+ * lengths and steals half of the biggest remaining shard when its own
+ * shard is finished.
+ */
+static void SweepReaders(READER_CONTEXT *ctx[], UINTN nb_readers)
+{
+	EFI_STATUS Status;
+	READER_CONTEXT **workers;
+	UINTN nb_workers = 0, i;
+	UINT32 ActiveProtocol, first, ok[2] = { 0, 0 }, failed = 0;
+
+	workers = AllocateZeroPool(nb_readers * sizeof *workers);
+	sweep.shards = AllocateZeroPool(nb_readers * sizeof *sweep.shards);
+	if ((NULL == workers) || (NULL == sweep.shards))
+		goto end;
+
+	/* keep the readers answering to a 1 byte extended APDU */
+	for (i=0; i<nb_readers; i++)
+	{
+		UINTN ReaderNameLength = sizeof ctx[i]->ReaderName;
+
+		Print(L"reader %d\n", ctx[i]->index);
+		ctx[i]->SmartCardReader->SCardStatus(ctx[i]->SmartCardReader,
+			ctx[i]->ReaderName, &ReaderNameLength, NULL, NULL, NULL, NULL);
+
+		Status = ctx[i]->SmartCardReader->SCardConnect(ctx[i]->SmartCardReader,
+			SCARD_AM_CARD,
+			SCARD_CA_COLDRESET,
+			SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
+			&ActiveProtocol);
+		if (EFI_ERROR(Status))
+		{
+			Print(L"ERROR: SCardConnect: %d\n", Status);
+			failure(ctx[i], "SCardConnect", 0, 0, Status);
+			continue;
+		}
+
+		if (extended_case3(ctx[i], 1))
+		{
+			ctx[i]->SmartCardReader->SCardDisconnect(ctx[i]->SmartCardReader,
+				SCARD_CA_NORESET);
+			continue;
+		}
+
+		ctx[i]->shard = nb_workers;
+		workers[nb_workers++] = ctx[i];
+	}
+
+	if (0 == nb_workers)
+	{
+		Print(L"ERROR: no reader with the test applet\n");
+		goto end;
+	}
+
+	sweep.nb_case3 = (cases & CASE3) ? 65535 : 0;
+	sweep.nb_items = sweep.nb_case3 + ((cases & CASE2) ? 65535 : 0);
+	sweep.nb_shards = nb_workers;
+	InitializeSpinLock(&sweep.lock);
+	for (i=0, first=0; i<nb_workers; i++)
+	{
+		sweep.shards[i].next = first;
+		first = sweep.nb_items * (i+1) / nb_workers;
+		sweep.shards[i].end = first;
+	}
+
+	Print(L"%d length(s) shared by %d reader(s)\n", sweep.nb_items,
+		nb_workers);
+	RunParallel(workers, nb_workers, SweepOnAP);
+
+	Print(L"\n");
+	for (i=0; i<nb_workers; i++)
+	{
+		workers[i]->SmartCardReader->SCardDisconnect(workers[i]->SmartCardReader,
+			SCARD_CA_NORESET);
+
+		Print(L"reader %d: %d length(s), %d steal(s)\n", workers[i]->index,
+			workers[i]->lengths[0] + workers[i]->lengths[1],
+			workers[i]->steals);
+		ok[0] += workers[i]->lengths[0];
+		ok[1] += workers[i]->lengths[1];
+		if (workers[i]->result)
+			failed++;
+	}
+
+	if (cases & CASE3)
+		Print(L"Case 3: %d/%d length(s) OK\n", ok[0], sweep.nb_case3);
+	if (cases & CASE2)
+		Print(L"Case 2: %d/%d length(s) OK\n", ok[1],
+			sweep.nb_items - sweep.nb_case3);
+	/* a reader stops at its failed length: one failed length each */
+	Print(L"%d reader(s) failed, %d length(s) not tested\n", failed,
+		sweep.nb_items - ok[0] - ok[1] - failed);
+
+end:
+	if (workers)
+		FreePool(workers);
+	if (sweep.shards)
+		FreePool(sweep.shards);
+}
+
+/* throughput in bytes/s of a Case */
+static UINT64 throughput(CONST BENCH *b, int c)
+{
+	if (0 == b->latency[c].total_ns)
+		return 0;
+
+	return DivU64x64Remainder(MultU64x32(b->bytes[c], 1000000000),
+		b->latency[c].total_ns, NULL);
+}
+
+/* us of a transfer, or - if it failed */
+static void print_transfer(UINT64 ns)
+{
+	if (ns)
+		Print(L" %9ld", DivU64x64Remainder(ns, 1000, NULL));
+	else
+		Print(L" %9a", "-");
+}
+
+/* extended APDU and chaining side by side */
+static void PrintTransports(READER_CONTEXT *ctx)
+{
+	UINTN i, t;
+
+	Print(L"           |   send (Case 3), us |  receive (Case 2), us\n");
+	Print(L"     bytes |  extended  chaining |  extended  chaining\n");
+	for (i=0; i<TRANSPORT_SIZES; i++)
+	{
+		Print(L"     %5d |", transport_sizes[i]);
+		for (t=0; t<2; t++)
+		{
+			print_transfer(ctx->transport_ns[i][t][TRANSPORT_EXTENDED]);
+			print_transfer(ctx->transport_ns[i][t][TRANSPORT_CHAINING]);
+			Print(t ? L"\n" : L" |");
+		}
+	}
+	Print(L"  faster: %a\n", transport_name(ctx->session.entry.transport));
+}
+
+/* UPDATE and READ BINARY side by side: us per command and bytes/s */
+static void PrintBinary(READER_CONTEXT *ctx)
+{
+	UINTN i, d;
+	UINT64 ns;
+
+	Print(L"           |     UPDATE BINARY   |      READ BINARY\n");
+	Print(L"     bytes |        us      B/s |        us      B/s\n");
+	for (i=0; i<BINARY_SIZES; i++)
+	{
+		Print(L"     %5d |", binary_sizes[i]);
+		for (d=0; d<2; d++)
+		{
+			ns = ctx->binary_ns[i][d];
+			print_transfer(ns);
+			if (ns)
+				Print(L" %8ld", DivU64x64Remainder(
+					MultU64x32(binary_sizes[i], 1000000000), ns, NULL));
+			else
+				Print(L" %8a", "-");
+			Print(d ? L"\n" : L" |");
+		}
+	}
+}
+
+/* T=0 and T=1 side by side */
+static void PrintBenchmark(READER_CONTEXT *ctx)
+{
+	int c, p;
+
+	Print(L"           |              T=0              |              T=1\n");
+	Print(L"           | APDUs  avg us  p95 us      B/s | APDUs  avg us  p95 us      B/s\n");
+	for (c=0; c<4; c++)
+	{
+		if (!(cases & (1 << c)))
+			continue;
+
+		Print(L"    Case %d ", c + 1);
+		for (p=0; p<2; p++)
+		{
+			CONST BENCH *b = &ctx->bench[p];
+			CONST HISTOGRAM *h = &b->latency[c];
+
+			if (!b->done)
+				Print(L"| %-29a ", "not supported");
+			else
+				Print(L"| %5ld %7ld %7ld %8ld ", h->count,
+					h->count ? DivU64x64Remainder(h->total_ns,
+						MultU64x32(h->count, 1000), NULL) : 0,
+					HistogramPercentile(h, 95), throughput(b, c));
+		}
+		Print(L"\n");
+	}
+
+	for (p=0; p<2; p++)
+		if (ctx->bench[p].done && ctx->bench[p].result)
+			Print(L"  T=%d workload FAILED\n", p);
+}
+
+/* per second of the report workload */
+static UINT64 report_rate(CONST READER_CONTEXT *ctx, UINT64 n)
+{
+	if (0 == ctx->report_ns)
+		return 0;
+
+	return DivU64x64Remainder(MultU64x32(n, 1000000000), ctx->report_ns,
+		NULL);
+}
+
+/* bytes/s of the report workload, all the Cases */
+static UINT64 report_throughput(CONST READER_CONTEXT *ctx)
+{
+	CONST BENCH *b = &ctx->report;
+
+	return report_rate(ctx, b->bytes[0] + b->bytes[1] + b->bytes[2]
+		+ b->bytes[3]);
+}
+
+/* TRUE if a ranks before b: fewer failed runs, then higher throughput */
+static BOOLEAN report_before(CONST READER_CONTEXT *a, CONST READER_CONTEXT *b)
+{
+	if (a->report.done != b->report.done)
+		return a->report.done;
+
+	if (a->report_failed != b->report_failed)
+		return a->report_failed < b->report_failed;
+
+	return report_throughput(a) > report_throughput(b);
+}
+
+/* the readers ranked, one line each */
+static void PrintReport(READER_CONTEXT *ctx[], UINTN nb_readers)
+{
+	READER_CONTEXT **ranked;
+	READER_CONTEXT *tmp;
+	HISTOGRAM all;
+	UINTN i, j;
+	int c;
+
+	ranked = AllocatePool(nb_readers * sizeof *ranked);
+	if (NULL == ranked)
+		return;
+	CopyMem(ranked, ctx, nb_readers * sizeof *ranked);
+
+	/* a few readers: insertion sort */
+	for (i=1; i<nb_readers; i++)
+		for (j=i; (j > 0) && report_before(ranked[j], ranked[j-1]); j--)
+		{
+			tmp = ranked[j];
+			ranked[j] = ranked[j-1];
+			ranked[j-1] = tmp;
+		}
+
+	Print(L"\nReport: %d run(s) of the short APDU Cases per reader\n",
+		REPORT_ROUNDS);
+	Print(L"  # reader                         T  APDUs/s       B/s  p99 us  failed  ATR\n");
+	for (i=0; i<nb_readers; i++)
+	{
+		CONST READER_CONTEXT *r = ranked[i];
+		CONST SESSION_ENTRY *e = &r->session.entry;
+
+		Print(L"%3d %-30.30s ", i + 1, r->ReaderName);
+		if (!r->report.done)
+		{
+			Print(L"not tested: %a\n",
+				r->failed_text ? r->failed_text : "-");
+			continue;
+		}
+
+		HistogramReset(&all);
+		for (c=0; c<4; c++)
+			HistogramMerge(&all, &r->report.latency[c]);
+
+		Print(L"%d %8ld %9ld %7ld  %2d/%d    ",
+			(SCARD_PROTOCOL_T1 == e->protocol) ? 1 : 0,
+			report_rate(r, all.count), report_throughput(r),
+			HistogramPercentile(&all, 99), r->report_failed, REPORT_ROUNDS);
+		for (j=0; j<e->AtrLength; j++)
+			Print(L"%02X", e->Atr[j]);
+		Print(L"\n");
+	}
+
+	FreePool(ranked);
+}
+
+static void PrintResult(READER_CONTEXT *ctx)
+{
+	Print(L"reader %d (%s): %d APDU(s): ", ctx->index, ctx->ReaderName,
+		ctx->exchanges);
+	if (0 == ctx->result)
+		Print(L"OK\n");
+	else
+		Print(L"FAILED: %a (%d, %d): %d\n", ctx->failed_text,
+			ctx->failed_s_length, ctx->failed_e_length, ctx->failed_status);
 
-		e[0] = 0x90;
-		e[1] = 0x00;
-		e_length = 2;
+	if (cached_transport)
+		Print(L"  transport: %a\n", transport_name(ctx->transport));
 
-		if (exchange(text, SmartCardReader,
-			s, dwSendLength, r, &dwRecvLength, e, e_length))
-			return 1;
+	if (sampled)
+	{
+		UINT32 total = ctx->boundary[0] + ctx->random[0]
+			+ ctx->boundary[1] + ctx->random[1];
+		UINT32 swept = ((cases & CASE3) ? 65535 : 0)
+			+ ((cases & CASE2) ? 65535 : 0);
+
+		Print(L"  seed %u: Case 3: %d boundary + %d random, "
+			L"Case 2: %d boundary + %d random, coverage %d.%02d%%\n",
+			seed, ctx->boundary[0], ctx->random[0],
+			ctx->boundary[1], ctx->random[1],
+			swept ? total * 100 / swept : 0,
+			swept ? (total * 10000 / swept) % 100 : 0);
 	}
 
-	if (cases & CASE1)
-	{
-		if (apdu)
-		{
-			/* Case 1, APDU */
-			text = "Case 1, APDU: CLA INS P1 P2, L(Cmd) = 4";
-			s[0] = 0x80;
-			s[1] = 0x30;
-			s[2] = 0x00;
-			s[3] = 0x00;
+	if (probe)
+		Print(L"  short Lc: %d, Le: %d, extended Lc: %d, Le: %d\n",
+			ctx->max_length[0], ctx->max_length[1], ctx->max_length[2],
+			ctx->max_length[3]);
 
-			dwSendLength = 4;
-			dwRecvLength = sizeof(r);
+	if (benchmark)
+		PrintBenchmark(ctx);
 
-			e[0] = 0x90;
-			e[1] = 0x00;
-			e_length = 2;
+	if (transports)
+		PrintTransports(ctx);
 
-			if (exchange(text, SmartCardReader,
-						s, dwSendLength, r, &dwRecvLength, e, e_length))
-				return 1;
-		}
+	if (binary)
+		PrintBinary(ctx);
 
-		if (tpdu)
-		{
-			/* Case 1, TPDU */
-			text = "Case 1, TPDU: CLA INS P1 P2 P3 (=0), L(Cmd) = 5";
-			s[0] = 0x80;
-			s[1] = 0x30;
-			s[2] = 0x00;
-			s[3] = 0x00;
-			s[4] = 0x00;
+	if (ctx->session.connected)
+		SessionPrint(&ctx->session);
 
-			dwSendLength = 5;
-			dwRecvLength = sizeof(r);
+	RetryPrintStats(&ctx->retry);
+}
 
-			e[0] = 0x90;
-			e[1] = 0x00;
-			e_length = 2;
+/*
+ * The baseline file has a line per reader and Case:
+ * Case APDUs avg_ns bytes/s ReaderName
+ * Empty lines and lines starting with # are ignored.
+ */
+static EFI_STATUS SaveBaseline(CONST CHAR16 *FileName,
+	READER_CONTEXT *ctx[], UINTN nb_readers)
+{
+	SHELL_FILE_HANDLE File;
+	EFI_STATUS Status;
+	CHAR8 line[200];
+	UINTN i, Size;
+	int c;
+
+	/* replace the previous baseline */
+	Status = ShellOpenFileByName(FileName, &File,
+		EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+	if (!EFI_ERROR(Status))
+		ShellDeleteFile(&File);
+
+	Status = ShellOpenFileByName(FileName, &File,
+		EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+	if (EFI_ERROR(Status))
+		return Status;
 
-			if (exchange(text, SmartCardReader,
-						s, dwSendLength, r, &dwRecvLength, e, e_length))
-				return 1;
-		}
-	}
+	Size = AsciiSPrint(line, sizeof line,
+		"# valid_SmartCardReader baseline: Case APDUs avg_ns bytes/s index reader\n");
+	Status = ShellWriteFile(File, &Size, line);
 
-	if (cases & CASE3)
+	for (i=0; (i<nb_readers) && !EFI_ERROR(Status); i++)
 	{
-		/* Case 3 */
-		/*
-		 * 248 (0xF8) is max size for one USB or GBP paquet
-		 * 255 (0xFF) maximum, 1 minimum
-		 */
-		text = "Case 3: CLA INS P1 P2 Lc Data, L(Cmd) = 5 + Lc";
-		end = 255;
-		start = 1;
-
-		for (len_i = start; len_i <= end; len_i++)
-		{
-			s[0] = 0x80;
-			s[1] = 0x32;
-			s[2] = 0x00;
-			s[3] = 0x00;
-			s[4] = len_i;
+		CONST BENCH *b = &ctx[i]->report;
 
-			for (i=0; i<len_i; i++)
-				s[5+i] = i;
+		/* only the readers that passed all the runs */
+		if (!b->done || ctx[i]->report_failed)
+			continue;
 
-			dwSendLength = len_i + 5;
-			dwRecvLength = sizeof(r);
+		for (c=0; (c<4) && !EFI_ERROR(Status); c++)
+		{
+			CONST HISTOGRAM *h = &b->latency[c];
 
-			e[0] = 0x90;
-			e[1] = 0x00;
-			e_length = 2;
+			if (0 == h->count)
+				continue;
 
-			if (exchange(text, SmartCardReader,
-				s, dwSendLength, r, &dwRecvLength, e, e_length))
-				return 1;
+			Size = AsciiSPrint(line, sizeof line, "%d %ld %ld %ld %d %s\n",
+				c + 1, h->count, DivU64x64Remainder(h->total_ns, h->count, NULL),
+				throughput(b, c), ctx[i]->index, ctx[i]->ReaderName);
+			Status = ShellWriteFile(File, &Size, line);
 		}
 	}
 
-	if (cases & CASE2)
-	{
-		/* Case 2 */
-		/*
-		 * 252  (0xFC) is max size for one USB or GBP paquet
-		 * 256 (0x100) maximum, 1 minimum
-		 */
-		text = "Case 2: CLA INS P1 P2 Le, L(Cmd) = 5";
-		end = 256;
-		start = 1;
+	ShellCloseFile(&File);
 
-		for (len_o = start; len_o <= end; len_o++)
-		{
-			s[0] = 0x80;
-			s[1] = 0x34;
-			if (len_o > 255)
-			{
-				s[2] = 0x01;
-				s[3] = len_o-256;
-			}
-			else
-			{
-				s[2] = 0x00;
-				s[3] = len_o;
-			}
-			s[4] = len_o;
+	return Status;
+}
 
-			dwSendLength = 5;
-			dwRecvLength = sizeof(r);
+static CHAR16 *skip_blanks(CHAR16 *p)
+{
+	while ((' ' == *p) || ('\t' == *p))
+		p++;
 
-			for (i=0; i<len_o; i++)
-				e[i] = i;
-			e[i++] = 0x90;
-			e[i++] = 0x00;
-			e_length = len_o+2;
+	return p;
+}
 
-			if (exchange(text, SmartCardReader,
-				s, dwSendLength, r, &dwRecvLength, e, e_length))
-				return 1;
-		}
+/* read a decimal number and skip it, NULL if there is none */
+static CHAR16 *read_number(CHAR16 *p, UINT64 *value)
+{
+	p = skip_blanks(p);
+	if ((*p < '0') || (*p > '9'))
+		return NULL;
 
-#if 0
-		/* Case 2, length too short */
-		text = "Case 2, length too short: CLA INS P1 P2 Le, L(Cmd) = 5";
-		len_o = 20;
+	*value = StrDecimalToUint64(p);
+	while ((*p >= '0') && (*p <= '9'))
+		p++;
 
-		s[0] = 0x80;
-		s[1] = 0x3C;
-		if (len_o > 255)
-		{
-			s[2] = 0x01;
-			s[3] = len_o-256;
-		}
-		else
-		{
-			s[2] = 0x00;
-			s[3] = len_o;
-		}
-		s[4] = len_o-10;
+	return p;
+}
 
-		dwSendLength = 5;
-		dwRecvLength = sizeof(r);
+static EFI_STATUS LoadBaseline(CONST CHAR16 *FileName)
+{
+	SHELL_FILE_HANDLE File;
+	EFI_STATUS Status;
+	CHAR16 line[200];
+	BOOLEAN Ascii = FALSE;
+	UINTN Size, line_number = 0;
+	UINT64 values[5];
+	CHAR16 *p;
+	int v;
+
+	Status = ShellOpenFileByName(FileName, &File, EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(Status))
+		return Status;
 
-		if (tpdu)
-		{
-			for (i=0; i<len_o; i++)
-				e[i] = i;
-			e[i++] = 0x90;
-			e[i++] = 0x00;
-			e_length = len_o+2;
-		}
-		else
-		{
-			e[0] = 0x6C;
-			e[1] = len_o;
-			e_length = 2;
-		}
+	nb_baseline = 0;
+	while (!ShellFileHandleEof(File))
+	{
+		Size = sizeof line;
+		Status = ShellFileHandleReadLine(File, line, &Size, FALSE, &Ascii);
+		if (EFI_ERROR(Status))
+			break;
+		line_number++;
 
-		if (exchange(text, SmartCardReader,
-			s, dwSendLength, r, &dwRecvLength, e, e_length))
-			return 1;
-#endif
+		p = skip_blanks(line);
+		if ((0 == *p) || ('#' == *p))
+			continue;
 
-#if 0
-		/* Case 2, length too long */
-		text = "Case 2, length too long: CLA INS P1 P2 Le, L(Cmd) = 5";
-		len_o = 20;
+		for (v=0; (v<5) && p; v++)
+			p = read_number(p, &values[v]);
 
-		s[0] = 0x80;
-		s[1] = 0x3C;
-		if (len_o > 255)
-		{
-			s[2] = 0x01;
-			s[3] = len_o-256;
-		}
-		else
+		if ((NULL == p) || (values[0] < 1) || (values[0] > 4)
+			|| (0 == *(p = skip_blanks(p))))
 		{
-			s[2] = 0x00;
-			s[3] = len_o;
+			Print(L"ERROR: %s line %d: invalid\n", FileName, line_number);
+			Status = EFI_INVALID_PARAMETER;
+			break;
 		}
-		s[4] = len_o+10;
-
-		dwSendLength = 5;
-		dwRecvLength = sizeof(r);
 
-		if (tpdu)
-		{
-			for (i=0; i<len_o; i++)
-				e[i] = i;
-			e[i++] = 0x90;
-			e[i++] = 0x00;
-			e_length = len_o+2;
-		}
-		else
+		if (nb_baseline >= BASELINE_MAX)
 		{
-			e[0] = 0x6C;
-			e[1] = len_o;
-			e_length = 2;
+			Print(L"ERROR: %s: more than %d lines\n", FileName, BASELINE_MAX);
+			Status = EFI_BUFFER_TOO_SMALL;
+			break;
 		}
 
-		if (exchange(text, SmartCardReader,
-			s, dwSendLength, r, &dwRecvLength, e, e_length))
-			return 1;
-#endif
+		baseline[nb_baseline].test_case = values[0];
+		baseline[nb_baseline].count = values[1];
+		baseline[nb_baseline].avg_ns = values[2];
+		baseline[nb_baseline].throughput = values[3];
+		baseline[nb_baseline].index = values[4];
+		StrCpyS(baseline[nb_baseline].ReaderName,
+			ARRAY_SIZE(baseline[nb_baseline].ReaderName), p);
+		nb_baseline++;
 	}
 
-	if (cases & CASE4)
-	{
-		if (tpdu)
-		{
-			/* Case 4, TPDU */
-			/*
-			 * len_i
-			 * 248 (0xF8) is max size for one USB or GBP paquet
-			 * 255 (0xFF) maximum, 1 minimum
-			 *
-			 * len_o
-			 * 252  (0xFC) is max size for one USB or GBP paquet
-			 * 256 (0x100) maximum, 1 minimum
-			 */
-			end = 255;
-			start = 1;
+	ShellCloseFile(&File);
 
-			for (len_i = start; len_i <= end; len_i++)
-			{
-				text = "Case 4, TPDU: CLA INS P1 P2 Lc Data, L(Cmd) = 5 + Lc";
-				len_o = 256 - len_i;
+	return Status;
+}
 
-				s[0] = 0x80;
-				s[1] = 0x36;
-				if (len_o > 255)
-				{
-					s[2] = 0x01;
-					s[3] = len_o-256;
-				}
-				else
-				{
-					s[2] = 0x00;
-					s[3] = len_o;
-				}
-				s[4] = len_i;
-
-				for (i=0; i<len_i; i++)
-					s[5+i] = i;
-
-				dwSendLength = len_i + 5;
-				dwRecvLength = sizeof(r);
-
-				e[0] = 0x61;
-				e[1] = len_o & 0xFF;
-				e_length = 2;
-
-				if (exchange(text, SmartCardReader,
-					s, dwSendLength, r, &dwRecvLength, e, e_length))
-					return 1;
-
-				/* Get response */
-				text = "Case 4, TPDU, Get response: ";
-				s[0] = 0x80;
-				s[1] = 0xC0;
-				s[2] = 0x00;
-				s[3] = 0x00;
-				s[4] = r[1]; /* SW2 of previous command */
-
-				dwSendLength = 5;
-				dwRecvLength = sizeof(r);
-
-				for (i=0; i<len_o; i++)
-					e[i] = i;
-				e[i++] = 0x90;
-				e[i++] = 0x00;
-				e_length = len_o+2;
-
-				if (exchange(text, SmartCardReader,
-					s, dwSendLength, r, &dwRecvLength, e, e_length))
-					return 1;
-			}
-		}
+/* print "old -> current (+x.y%)", return the change in 0.1% */
+static INT64 print_change(UINT64 old, UINT64 current)
+{
+	INT64 permille = 0;
 
-		if (apdu)
-		{
-			/* Case 4, APDU */
-			/*
-			 * len_i
-			 * 248 (0xF8) is max size for one USB or GBP paquet
-			 * 255 (0xFF) maximum, 1 minimum
-			 *
-			 * len_o
-			 * 252  (0xFC) is max size for one USB or GBP paquet
-			 * 256 (0x100) maximum, 1 minimum
-			 */
-			text = "Case 4, APDU: CLA INS P1 P2 Lc Data Le, L(Cmd) = 5 + Lc +1";
-			end = 255;
-			start = 1;
-
-			for (len_i = start; len_i <= end; len_i++)
-			{
-				len_o = 256 - len_i;
+	if (old)
+		permille = (INT64)DivU64x64Remainder(MultU64x32(current, 1000), old, NULL)
+			- 1000;
 
-				s[0] = 0x80;
-				s[1] = 0x36;
-				if (len_o > 255)
-				{
-					s[2] = 0x01;
-					s[3] = len_o-256;
-				}
-				else
-				{
-					s[2] = 0x00;
-					s[3] = len_o;
-				}
-				s[4] = len_i;
+	Print(L"%9ld -> %9ld (%c%ld.%ld%%)", old, current,
+		(permille < 0) ? '-' : '+',
+		((permille < 0) ? -permille : permille) / 10,
+		((permille < 0) ? -permille : permille) % 10);
 
-				for (i=0; i<len_i; i++)
-					s[5+i] = i;
-				s[5+len_i] = len_o & 0xFF;
+	return permille;
+}
 
-				dwSendLength = len_i + 6;
-				dwRecvLength = sizeof(r);
+/*
+ * Compare each line of the baseline with the Case of the reader of the
+ * same index and name. A Case regresses if its average latency is
+ * higher or its throughput is lower by more than its threshold, or if
+ * it was not measured. A reader of the baseline that is missing and a
+ * reader with failed runs also count as regressions. Return the number
+ * of regressions.
+ */
+static UINTN CompareBaseline(READER_CONTEXT *ctx[], UINTN nb_readers)
+{
+	UINTN i, j, regressions = 0;
+	READER_CONTEXT *reader = NULL;
 
-				for (i=0; i<len_o; i++)
-					e[i] = i;
-				e[i++] = 0x90;
-				e[i++] = 0x00;
-				e_length = len_o+2;
+	Print(L"\nBaseline %s, threshold: Case 1 %d%%, 2 %d%%, 3 %d%%, 4 %d%%\n",
+		baseline_load, threshold[0], threshold[1], threshold[2],
+		threshold[3]);
 
-				if (exchange(text, SmartCardReader,
-					s, dwSendLength, r, &dwRecvLength, e, e_length))
-					return 1;
-			}
+	for (j=0; j<nb_baseline; j++)
+	{
+		CONST BASELINE *base = &baseline[j];
+		READER_CONTEXT *r = NULL;
+		CONST BENCH *b;
+		CONST HISTOGRAM *h;
+		UINTN c = base->test_case - 1;
+		INT64 latency, bps;
+		INT64 limit = threshold[c] * 10;
+
+		for (i=0; i<nb_readers; i++)
+			if ((ctx[i]->index == base->index)
+				&& (0 == StrCmp(ctx[i]->ReaderName, base->ReaderName)))
+				r = ctx[i];
+
+		if (NULL == r)
+		{
+			Print(L"reader %d (%s) Case %d: not tested: REGRESSION\n",
+				base->index, base->ReaderName, base->test_case);
+			reader = NULL;
+			regressions++;
+			continue;
 		}
-	}
-
-	return 0;
-} /* short_apdu */
 
-int CheckReader(EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader)
-{
-	EFI_STATUS  Status;
-	CHAR16 ReaderName[100];
-	UINTN ReaderNameLength = sizeof ReaderName;
-	UINT32 State;
-	UINT32 CardProtocol;
-	UINT8 Atr[33];
-	UINTN AtrLength = sizeof Atr;
-	UINT32 ActiveProtocol;
-	int i;
+		if (r != reader)
+		{
+			Print(L"reader %d (%s)\n", r->index, r->ReaderName);
+			reader = r;
+		}
 
-	/*
-	 * SCardStatus
-	 */
-	Status = SmartCardReader->SCardStatus(SmartCardReader,
-			ReaderName,
-			&ReaderNameLength,
-			&State,
-			&CardProtocol,
-			Atr,
-			&AtrLength);
-	if (EFI_ERROR(Status))
-	{
-		Print(L"ERROR: SCardStatus: %d\n", Status);
-		return 0;
-	}
+		b = &r->report;
+		h = &b->latency[c];
+		Print(L"  Case %d: avg ns ", base->test_case);
+		if (!b->done || (0 == h->count))
+		{
+			/* the Case did not run */
+			Print(L"%9ld -> not measured: REGRESSION\n", base->avg_ns);
+			regressions++;
+			continue;
+		}
 
-	Print(L"ReaderName (%d): %s\n", ReaderNameLength, ReaderName);
-	Print(L"State: %d: ", State);
-	switch(State)
-	{
-		case SCARD_UNKNOWN:
-			Print(L"SCARD_UNKNOWN");
-			break;
-		case SCARD_ABSENT:
-			Print(L"SCARD_ABSENT");
-			break;
-		case SCARD_INACTIVE:
-			Print(L"SCARD_INACTIVE");
-			break;
-		case SCARD_ACTIVE:
-			Print(L"SCARD_ACTIVE");
-			break;
-	}
-	Print(L"\n");
-	Print(L"CardProtocol: %d\n", CardProtocol);
-	Print(L"Atr (%d): ", AtrLength);
-	for (i=0; i<AtrLength; i++)
-		Print(L"%02X ", Atr[i]);
-	Print(L"\n");
+		latency = print_change(base->avg_ns,
+			DivU64x64Remainder(h->total_ns, h->count, NULL));
+		Print(L", B/s ");
+		bps = print_change(base->throughput, throughput(b, c));
 
-	/*
-	 * SCardConnect
-	 */
-	Status = SmartCardReader->SCardConnect(SmartCardReader,
-		SCARD_AM_CARD,
-		SCARD_CA_COLDRESET,
-		SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
-		&ActiveProtocol);
-	if (EFI_ERROR(Status))
-	{
-		Print(L"ERROR: SCardConnect: %d\n", Status);
-		return 0;
+		if ((latency > limit) || (bps < -limit))
+		{
+			Print(L": REGRESSION");
+			regressions++;
+		}
+		Print(L"\n");
 	}
 
-	if (extended)
-		extended_apdu(SmartCardReader);
-	else
-		short_apdu(SmartCardReader);
+	/* the averages hide the runs that failed */
+	for (i=0; i<nb_readers; i++)
+		if (ctx[i]->report.done && ctx[i]->report_failed)
+		{
+			Print(L"reader %d (%s): %d/%d failed run(s): REGRESSION\n",
+				ctx[i]->index, ctx[i]->ReaderName, ctx[i]->report_failed,
+				REPORT_ROUNDS);
+			regressions++;
+		}
 
-	/*
-	 * SCardDisconnect
-	 */
-	Status = SmartCardReader->SCardDisconnect(SmartCardReader,
-		SCARD_CA_NORESET);
-	if (EFI_ERROR(Status))
-	{
-		Print(L"ERROR: SCardDisconnect: %d\n", Status);
-		return 0;
-	}
+	if (regressions)
+		Print(L"%d regression(s)\n", regressions);
 
-	return 0;
+	return regressions;
 }
 
 /***
@@ -703,8 +2414,18 @@ ShellAppMain (
 	UINTN       HandleIndex, HandleCount;
 	EFI_HANDLE  *DevicePathHandleBuffer = NULL;
 	EFI_SMART_CARD_READER_PROTOCOL *SmartCardReader;
+	READER_CONTEXT **contexts;
+	UINTN nb_contexts = 0;
 	int i;
 	int reader = -1;
+	INTN exit_code = 0;
+
+	/* before any measure */
+	StopwatchInit();
+
+	/* no retry unless asked: the validation must see the errors */
+	RetryInit(&retry_policy);
+	retry_policy.policy.max_attempts = 1;
 
 	for (i=0; i<Argc; i++)
 	{
@@ -738,16 +2459,184 @@ ShellAppMain (
 			case 'a':
 				apdu = 1;
 				tpdu = 0;
+				break;
+
+			case 'p':
+				parallel = TRUE;
+				Print(L"check the readers in parallel\n");
+				break;
+
+			case 'm':
+				probe = TRUE;
+				Print(L"probe the maximum APDU lengths\n");
+				break;
+
+			case 'n':
+				sampled = TRUE;
+				extended = TRUE;
+				if (Argv[i][1])
+					seed = StrDecimalToUintn(Argv[i]+1);
+				else
+				{
+					EFI_TIME Time;
+
+					if (!EFI_ERROR(gRT->GetTime(&Time, NULL)))
+						seed = Time.Nanosecond ^ (Time.Second
+							+ 60 * (Time.Minute + 60 * Time.Hour));
+				}
+				Print(L"sampled extended APDU sweep, seed: %u\n", seed);
+				break;
+
+			case 'c':
+				resume = TRUE;
+				Print(L"resume the extended APDU sweep from the checkpoint\n");
+				break;
+
+			case 's':
+				sharded = TRUE;
+				extended = TRUE;
+				Print(L"share the extended APDU sweep between the readers\n");
+				break;
+
+			case 'R':
+				retry_policy.policy.max_attempts = Argv[i][1] ?
+					StrDecimalToUintn(Argv[i]+1) : 3;
+				Print(L"retry the failed exchanges: %d attempts\n",
+					retry_policy.policy.max_attempts);
+				break;
+
+			case 'D':
+				retry_policy.policy.backoff_us = StrDecimalToUintn(Argv[i]+1);
+				Print(L"retry backoff: %d us\n", retry_policy.policy.backoff_us);
+				break;
+
+			case 'B':
+				retry_policy.policy.budget_us = MultU64x32(
+					StrDecimalToUintn(Argv[i]+1), 1000);
+				Print(L"recovery budget: %ld us\n", retry_policy.policy.budget_us);
+				break;
+
+			case 'W':
+				retry_policy.policy.warm_reset = FALSE;
+				Print(L"no warm reset when retrying\n");
+				break;
+
+			case 'b':
+				benchmark = TRUE;
+				Print(L"benchmark T=0 against T=1\n");
+				break;
+
+			case 'x':
+				transports = TRUE;
+				Print(L"benchmark extended APDU against command chaining\n");
+				break;
+
+			case 'X':
+				cached_transport = TRUE;
+				Print(L"use the transport of the session cache\n");
+				break;
+
+			case 'N':
+				fresh_session = TRUE;
+				Print(L"do not reuse the session cache\n");
+				break;
+
+			case 'l':
+				contactless = TRUE;
+				Print(L"contactless interface\n");
+				break;
+
+			case 'o':
+				combi = TRUE;
+				Print(L"combi card applet\n");
+				break;
+
+			case 'k':
+				report = TRUE;
+				Print(L"compare the readers\n");
+				break;
+
+			case 'w':
+				baseline_save = Argv[i]+1;
+				report = TRUE;
+				Print(L"save the baseline in %s\n", baseline_save);
+				break;
+
+			case 'g':
+				baseline_load = Argv[i]+1;
+				report = TRUE;
+				Print(L"compare with the baseline %s\n", baseline_load);
+				break;
+
+			case 'T':
+				/* T<percent> for all the Cases or T<case>:<percent> */
+				{
+					CHAR16 *p;
+					UINT64 c, percent;
+
+					p = read_number(Argv[i]+1, &percent);
+					if (p && (':' == *p))
+					{
+						c = percent;
+						p = read_number(p+1, &percent);
+						if ((c < 1) || (c > 4))
+							p = NULL;
+					}
+					else
+						c = 0;
+
+					if ((NULL == p) || *p)
+					{
+						Print(L"ERROR: invalid threshold %s\n", Argv[i]);
+						return 1;
+					}
+
+					if (c)
+						threshold[c-1] = percent;
+					else
+						for (c=0; c<4; c++)
+							threshold[c] = percent;
+					Print(L"regression threshold: Case 1 %d%%, 2 %d%%, 3 %d%%, 4 %d%%\n",
+						threshold[0], threshold[1], threshold[2], threshold[3]);
+				}
+				break;
+
+			case 'u':
+				binary = TRUE;
+				contactless = TRUE;
+				Print(L"benchmark READ/UPDATE BINARY\n");
+				break;
+		}
+	}
+
+	/* also with 'N': the entries of the other cards are kept */
+	SessionCacheLoad(&session_cache);
+
+	/* before the tests, they are long */
+	if (baseline_load)
+	{
+		Status = LoadBaseline(baseline_load);
+		if (EFI_ERROR(Status))
+		{
+			Print(L"ERROR: Can't read %s: %d\n", baseline_load, Status);
+			return 1;
 		}
+		Print(L"%d baseline result(s)\n", nb_baseline);
 	}
 
+	/* the benchmark and the report run all the Cases unless some are given */
+	if ((benchmark || report) && (0 == cases))
+		cases = CASE1 | CASE2 | CASE3 | CASE4;
+
 	/* EFI_SMART_CARD_READER_PROTOCOL */
+	PERF_INMODULE_BEGIN("Enumerate");
 	Status = gBS->LocateHandleBuffer(
 			ByProtocol,
 			&gEfiSmartCardReaderProtocolGuid,
 			NULL,
 			&HandleCount,
 			&DevicePathHandleBuffer);
+	PERF_INMODULE_END("Enumerate");
 
 	if (EFI_ERROR(Status))
 	{
@@ -755,9 +2644,18 @@ ShellAppMain (
 		return 0;
 	}
 
+	contexts = AllocateZeroPool(HandleCount * sizeof *contexts);
+	if (NULL == contexts)
+	{
+		gBS->FreePool(DevicePathHandleBuffer);
+		return 0;
+	}
+
 	Print(L"Found %d reader(s)\n", HandleCount);
 	for (HandleIndex = 0; HandleIndex < HandleCount; HandleIndex++)
 	{
+		READER_CONTEXT *ctx;
+
 		ZeroMem(&SmartCardReader, sizeof SmartCardReader);
 
 		Status = gBS->HandleProtocol(
@@ -768,15 +2666,71 @@ ShellAppMain (
 		if (EFI_ERROR(Status))
 		{
 			Print(L"ERROR: Open UsbIo fail.\n");
-			gBS->FreePool(DevicePathHandleBuffer);
-			return 0;
+			break;
+		}
+
+		if (!(reader < 0 || reader == HandleIndex))
+			continue;
+
+		ctx = NewContext(SmartCardReader, HandleIndex);
+		if (NULL == ctx)
+		{
+			Print(L"ERROR: not enough memory\n");
+			break;
 		}
+		contexts[nb_contexts++] = ctx;
 
-		Print(L"reader %d\n", HandleIndex);
-		if (reader < 0 || reader == HandleIndex)
-			CheckReader(SmartCardReader);
+		if (!parallel && !sharded)
+		{
+			Print(L"reader %d\n", HandleIndex);
+			CheckReader(ctx);
+			FreeBuffers(ctx);
+		}
 	}
 	gBS->FreePool(DevicePathHandleBuffer);
 
-	return(0);
+	if (sharded)
+		SweepReaders(contexts, nb_contexts);
+	else
+		if (parallel)
+			RunParallel(contexts, nb_contexts, CheckReaderOnAP);
+
+	/* from the BSP, once all the readers are done */
+	Status = EFI_NOT_STARTED;
+	for (i=0; i<nb_contexts; i++)
+		if (contexts[i]->session.connected
+			&& SessionUpdate(&session_cache, &contexts[i]->session))
+			Status = EFI_SUCCESS;
+	if (!EFI_ERROR(Status))
+	{
+		Status = SessionCacheSave(&session_cache);
+		if (EFI_ERROR(Status))
+			Print(L"ERROR: SetVariable: %d\n", Status);
+	}
+
+	Print(L"\n");
+	for (i=0; i<nb_contexts; i++)
+		PrintResult(contexts[i]);
+
+	if (report)
+		PrintReport(contexts, nb_contexts);
+
+	if (baseline_load && CompareBaseline(contexts, nb_contexts))
+		exit_code = EXIT_REGRESSION;
+
+	if (baseline_save)
+	{
+		Status = SaveBaseline(baseline_save, contexts, nb_contexts);
+		if (EFI_ERROR(Status))
+		{
+			Print(L"ERROR: Can't write %s: %d\n", baseline_save, Status);
+			exit_code = 1;
+		}
+	}
+
+	for (i=0; i<nb_contexts; i++)
+		FreeContext(contexts[i]);
+	FreePool(contexts);
+
+	return(exit_code);
 }